@@ -1,16 +1,31 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <getopt.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <inttypes.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "jsmn.h"
@@ -20,12 +35,245 @@
 // https://github.com/ArweaveTeam/arweave/blob/a897b8cce6e93038625866f053d5cba07701c30c/apps/arweave/include/ar.hrl#L330-L331
 #define MAX_CHUNK_SIZE 262144
 
+// How many idle keep-alive connections we hold on to per node
+#define MAX_POOL_CONNECTIONS 16
 
+// How many /chunk requests are written ahead on one connection before
+// the first response is read back
+#define PIPELINE_DEPTH 4
+
+// Upper bound for --jobs, the number of connections kept busy at once
+#define MAX_JOBS 256
+
+// Upper bound for repeated --node flags
+#define MAX_NODES 16
+
+// recv() size for reading responses, a /chunk body fits in a handful of these
+#define HTTP_READ_BUFFER_SIZE (64 * 1024)
+
+// Longest status or header line we accept from a node
+#define HTTP_MAX_LINE 4096
+
+// Size a --stdin pipe is taken to be until its header says how long it is
+#define LOCAL_SIZE_UNKNOWN (UINT64_MAX / 2)
+
+// --cache cap when --cache-size isn't given, in MB
+#define DEFAULT_CACHE_SIZE_MB 4096
+
+// Offset lookups kept in flight by --batch
+#define LOOKAHEAD_DEPTH 16
+
+// Latencies kept per node to estimate its p95 from
+#define NODE_LATENCY_SAMPLES 256
+
+// Nodes this many times slower than the fastest one get no new chunks...
+#define SLOW_NODE_FACTOR 4
+// ...except one every this many seconds, so we notice when they speed up
+#define NODE_PROBE_INTERVAL 1.0
+
+// Samples a node needs before its p95 is trusted to hedge on
+#define HEDGE_MIN_SAMPLES 20
+
+// Attempts at a chunk or an offset lookup before giving up on the bundle
+#define MAX_FETCH_ATTEMPTS 8
+
+// Retry n waits a random time up to min(RETRY_MAX_DELAY, RETRY_BASE_DELAY * 2^(n-1))
+#define RETRY_BASE_DELAY 0.1
+#define RETRY_MAX_DELAY 10.0
+
+// How often the --resume checkpoint is rewritten while chunks come in, in seconds
+#define CHECKPOINT_INTERVAL 1.0
+
+// Latency histograms split every power of two of nanoseconds into
+// HISTOGRAM_SUB_BUCKETS linear buckets, so a bucket is never wider than
+// 1/16 of the values in it. Anything past 2^HISTOGRAM_MAX_BITS ns (about
+// 18 minutes) lands in the last bucket.
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Chunk buffers are carved out of slabs this many at a time, 2 MB, which
+// is one huge page on x86-64
+#define CHUNK_POOL_SLAB_BUFFERS 8
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// --verify: a decoded data_path is a 96 byte branch per tree level and a
+// 64 byte leaf, this is room for far deeper trees than any bundle has
+#define DATA_PATH_MAX_SIZE 8192
+// chunks handed to the verify workers before the fetch loop has to wait
+#define VERIFY_QUEUE_DEPTH 16
+#define VERIFY_MAX_WORKERS 16
+// --recursive, threads dissecting nested bundles at most
+#define NESTED_MAX_WORKERS 16
+// --filter predicates at most, and the longest tag name or value they match
+#define FILTER_MAX 16
+#define FILTER_TAG_MAX 256
+
+
+// Bytes read off a socket and not yet fed to the response parser
+struct HttpReader {
+  char *buf;
+  int start;
+  int end;
+};
+
+struct ArweaveConnection {
+  int sock;
+  int reused;
+  struct HttpReader rd;
+};
+
+// Where the parser is inside the response it is being fed
+enum HttpParseState {
+  HTTP_STATUS_LINE,
+  HTTP_HEADERS,
+  HTTP_BODY,
+  HTTP_BODY_UNTIL_CLOSE,
+  HTTP_CHUNK_SIZE,
+  HTTP_CHUNK_DATA,
+  HTTP_CHUNK_CRLF,
+  HTTP_TRAILERS,
+  HTTP_DONE
+};
+
+// Receives body bytes as the parser recognises them, -1 aborts the response
+typedef int (*HttpBodyConsumer)(void *ctx, const char *data, int len);
+
+struct HttpResponse {
+  int state;
+  int status;
+  int64_t content_length;
+  int chunked;
+  int keep_alive;
+  int64_t remaining;
+  int64_t body_len;
+  uint64_t recv_calls;
+  // when the response became the next one due on its connection, and when
+  // its first byte was fed to the parser, 0 until then
+  double started;
+  double first_byte;
+  char line[HTTP_MAX_LINE];
+  int line_len;
+  HttpBodyConsumer consumer;
+  void *ctx;
+  // when set the body is received straight into this buffer instead
+  char *direct;
+  int direct_cap;
+};
+
+// Collects a body into one contiguous buffer
+struct PageSink {
+  char *page;
+  int len;
+  int cap;
+  int overflow;
+};
+
+struct ArweaveConnectionPool {
+  pthread_mutex_t lock;
+  int idle[MAX_POOL_CONNECTIONS];
+  int idle_cnt;
+  uint64_t connections_opened;
+  uint64_t requests_served;
+  uint64_t recv_calls;
+};
+
+// How fast a node has been answering chunk requests
+struct NodeStats {
+  // moving averages of request latency (seconds) and body throughput (bytes/sec)
+  double latency;
+  double throughput;
+  double p95;
+  double last_used;
+  uint64_t samples;
+  double recent[NODE_LATENCY_SAMPLES];
+  uint64_t hedges_sent;
+  uint64_t hedges_won;
+  // failed requests in a row, and when to try the node again
+  int failures;
+  double down_until;
+};
 
 struct ArweaveNode {
   char domain[256];
   int port;
   struct hostent *host;
+  // gethostbyname hands out one static hostent, keep our own copy
+  struct in_addr addr;
+  struct ArweaveConnectionPool pool;
+  struct NodeStats stats;
+};
+
+/**
+ * On-disk cache of decoded chunks, one file per chunk named after the
+ * absolute weave offset it starts at. Bytes at a weave offset never change,
+ * so entries never go stale; the least recently used ones (by mtime) are
+ * evicted once the directory grows past cap bytes.
+ **/
+struct ChunkCache {
+  char dir[512];
+  uint64_t cap;
+  uint64_t used;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t hit_bytes;
+  uint64_t evictions;
+};
+
+/**
+ * --resume checkpoint of the bundle being fetched. A pass over the bundle
+ * (the whole of it, or the header and then the --item) marks the
+ * MAX_CHUNK_SIZE aligned chunks it parsed in done. The file also holds the
+ * parser state as of resume_offset, the end of the last chunk parsed.
+ **/
+struct Checkpoint {
+  // --resume directory, one <tx_id>.checkpoint file per bundle in it
+  char dir[512];
+  char path[800];
+  uint8_t *done;
+  uint64_t chunk_cnt;
+  // bundle relative bytes parsed back to back in this pass
+  uint64_t run_start;
+  uint64_t run_end;
+  // weave offset the parser state is as of
+  uint64_t resume_offset;
+  double saved_at;
+};
+
+/**
+ * A mapped --index file, see struct BundleIndexRecord. The columns point
+ * right into the mapping.
+ **/
+struct BundleIndex {
+  void *map;
+  size_t len;
+  const struct BundleIndexRecord *rec;
+  const uint8_t (*ids)[32];
+  const uint32_t *order;
+  const uint64_t *starts;
+  const uint64_t *sizes;
+};
+
+/**
+ * --file or --stdin bundle, mapped, or read off a pipe a chunk at a time.
+ * It's cut into chunks where the nodes would have cut it, and those are
+ * parsed in place.
+ **/
+struct LocalBundle {
+  const char *path;
+  // the whole bundle, NULL while it's streamed off a pipe
+  char *data;
+  // LOCAL_SIZE_UNKNOWN for a pipe until its header is in
+  uint64_t size;
+  // otherwise read off a pipe, in whole into data for --recursive
+  int mapped;
+  // the pipe, and the aligned chunk of it last read into buf
+  int fd;
+  char *buf;
+  uint64_t buf_pos;
+  uint64_t buf_len;
+  int eof;
 };
 
 struct ArweaveBundle {
@@ -33,7 +281,34 @@ struct ArweaveBundle {
   uint64_t endOffset;
   uint64_t startOffset;
   uint64_t currentOffset;
+  // last weave offset the current pass needs, endOffset for a full sweep
+  uint64_t fetchEndOffset;
+  // last weave offset of the run of chunks missing from the cache
+  uint64_t runEndOffset;
   uint64_t size;
+  // --item, the only data item to pull out of the bundle
+  char item_id[64];
+  // --extract, the data items to pull out in one pass, NULL without it
+  struct ExtractPlan *plan;
+  // --unbundle, directory every data item is written out to
+  char *unbundle_dir;
+  // fetch byte ranges of /raw/<tx_id> instead of base64url /chunk pages
+  int raw;
+  struct ChunkCache *cache;
+  // --resume, NULL without it
+  struct Checkpoint *checkpoint;
+  // --verify, NULL without it
+  struct ChunkVerifier *verifier;
+  // --index, directory of one <tx_id>.index file per bundle dissected
+  char *index_dir;
+  // index of this bundle found in index_dir, NULL when there is none
+  struct BundleIndex *index;
+  // --file or --stdin, NULL when the bundle comes from the nodes
+  struct LocalBundle *local;
+  // --filter, NULL without it, and the weave offset it lets the fetch
+  // jump ahead to, 0 when none
+  struct TagFilter *filter;
+  uint64_t skipToOffset;
 };
 
 struct ArweaveDataItemInfo {
@@ -43,9 +318,22 @@ struct ArweaveDataItemInfo {
   uint64_t endOffset;
 };
 
+/**
+ * ANS-104 bundle header: a 32 byte item count followed by one 64 byte
+ * (size, id) entry per data item. The entries are kept as a structure of
+ * arrays so a lookup only walks the column it searches.
+ **/
 struct ArweaveBundleHeader {
   uint32_t data_item_cnt;
-  struct ArweaveDataItemInfo *offsets[];
+  uint32_t entry_cnt;
+  uint32_t entry_cap;
+  uint64_t *sizes;
+  uint8_t (*ids)[32];
+  // where each item starts, relative to the first byte of the bundle
+  uint64_t *starts;
+  // a count or entry cut in two by a chunk boundary
+  uint8_t partial[64];
+  int partial_len;
 };
 
 struct StateMachine {
@@ -54,8 +342,26 @@ struct StateMachine {
   int di_cnt_done;
   int offset_done;
   int header_done;
+  // entry of the item being written out to item_fd, -1 while unknown
+  int64_t item_index;
+  int item_fd;
+  uint64_t item_written;
+  // --items, walks the data item headers once the offsets table is in
+  struct DataItemParser *items;
+  // --recursive, watches the items parser for nested bundles
+  struct NestedScanner *nested;
+  // --filter, a bit per entry whose tags don't match, NULL without it
+  uint8_t *item_drop;
 };
 
+/**
+ * @brief Last weave offset the network fetch loops may go up to
+ **/
+uint64_t FetchLimit(struct ArweaveBundle *arBundle) {
+  return arBundle->fetchEndOffset < arBundle->runEndOffset ? arBundle->fetchEndOffset
+                                                           : arBundle->runEndOffset;
+}
+
 static const uint8_t base64urlDecTable[128] =  {
   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
@@ -108,516 +414,8044 @@ uint64_t strToLong(const char *buff) {
   return (uint64_t)sl;
 }
 
-int ReadHttpStatus(int sock) {
-  char c;
-  char buff[1024] = "";
-  char *ptr = buff + 1;
-  int bytes_received;
-  int status;
+double MonotonicSeconds(void) {
+  struct timespec ts;
 
-  printf("Begin Response ..\n");
-  while ((bytes_received = recv(sock, ptr, 1, 0))) {
-    if (bytes_received == -1) {
-      perror("ReadHttpStatus");
-      exit(1);
-    }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    if ((ptr[-1] == '\r') && (*ptr == '\n'))
-      break;
-    ptr++;
-  }
-  *ptr = 0;
-  ptr = buff + 1;
+// Stages of getting a chunk parsed that the run keeps latency histograms of
+enum StatStage {
+  STAT_DNS,
+  STAT_CONNECT,
+  STAT_TTFB,
+  STAT_BODY,
+  STAT_DECODE,
+  STAT_PARSE,
+  STAT_STAGES
+};
+
+static const char *statStageNames[STAT_STAGES] = {
+  "dns", "connect", "ttfb", "body", "decode", "parse"
+};
+
+// Log-linear histogram of nanosecond values, in the spirit of HdrHistogram
+struct Histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Counters and latency histograms of the whole run. They are only touched
+ * by the thread driving the fetch, and dumped as JSON with --stats at exit
+ * or on SIGUSR1.
+ **/
+struct RunStats {
+  double started;
+  uint64_t connections;
+  uint64_t responses;
+  uint64_t recv_calls;
+  uint64_t bytes_received;
+  uint64_t chunks;
+  uint64_t chunk_bytes;
+  uint64_t retries;
+  uint64_t hedges;
+  struct Histogram stages[STAT_STAGES];
+};
+
+static struct RunStats runStats;
+// --stats, where the JSON goes; without it a SIGUSR1 dump goes to stderr
+static const char *statsPath;
+// what was stdout when --stats is -
+static FILE *statsOut;
+static volatile sig_atomic_t statsDumpRequested;
+// --verbose, log every response and data item
+static int verbose;
 
-  sscanf(ptr, "%*s %d ", &status);
+int HistogramIndex(uint64_t value) {
+  int shift;
 
-  printf("%s\n", ptr);
-  printf("status=%d\n", status);
-  printf("End Response ..\n");
-  return (bytes_received > 0) ? status : 0;
+  if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  if (value >= 1ULL << HISTOGRAM_MAX_BITS) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (value >> shift) - HISTOGRAM_SUB_BUCKETS;
 }
 
-int ParseHeader(int sock) {
-  char c;
-  char buff[1024] = "";
-  char *ptr = buff + 4;
-  int bytes_received;
-  int status;
+/**
+ * @brief Highest value that falls into a bucket
+ **/
+uint64_t HistogramBucketValue(int index) {
+  int shift;
 
-  printf("Begin HEADER ..\n");
-  while ((bytes_received = recv(sock, ptr, 1, 0))) {
-    if (bytes_received == -1) {
-      perror("Parse Header");
-      exit(1);
-    }
+  if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  return ((uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
 
-    if ((ptr[-3] == '\r') && (ptr[-2] == '\n') && (ptr[-1] == '\r') &&
-        (*ptr == '\n')) {
-      break;
-    }
-    ptr++;
+void HistogramRecord(struct Histogram *h, uint64_t value) {
+  if (h->count == 0 || value < h->min) {
+    h->min = value;
   }
+  if (value > h->max) {
+    h->max = value;
+  }
+  h->count++;
+  h->sum += value;
+  h->buckets[HistogramIndex(value)]++;
+}
 
-  *ptr = 0;
-  ptr = buff + 4;
-  // printf("%s",ptr);
+/**
+ * @brief Value at or below which a fraction q of the recorded values are
+ **/
+uint64_t HistogramPercentile(const struct Histogram *h, double q) {
+  uint64_t rank = (uint64_t)(q * h->count + 0.999999);
+  uint64_t seen = 0;
+  uint64_t value;
 
-  if (bytes_received) {
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if ((seen += h->buckets[i]) >= rank) {
+      value = HistogramBucketValue(i);
+      return value < h->max ? value : h->max;
+    }
+  }
+  return h->max;
+}
 
-    ptr = strstr(ptr, "content-length:");
+/**
+ * @brief Account secs spent in a stage
+ **/
+void StatsRecord(int stage, double secs) {
+  HistogramRecord(&runStats.stages[stage], secs > 0 ? (uint64_t)(secs * 1e9) : 0);
+}
 
-    /* if (ptr == NULL) { */
-    /*   strstr(ptr, "content-length:"); */
-    /* } */
+void StatsWriteHistogram(FILE *out, const struct Histogram *h) {
+  int first = 1;
 
-    if (ptr) {
-      sscanf(ptr, "%*s %d", &bytes_received);
-    } else {
-      bytes_received = -1; // unknown size
+  fprintf(out, "{\"count\": %" PRIu64, h->count);
+  if (h->count > 0) {
+    fprintf(out, ", \"min\": %" PRIu64 ", \"mean\": %" PRIu64 ", \"p50\": %" PRIu64
+            ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p999\": %" PRIu64
+            ", \"max\": %" PRIu64, h->min, h->sum / h->count, HistogramPercentile(h, 0.5),
+            HistogramPercentile(h, 0.9), HistogramPercentile(h, 0.99),
+            HistogramPercentile(h, 0.999), h->max);
+  }
+  // non-empty buckets as [highest value, count] pairs
+  fprintf(out, ", \"buckets\": [");
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (h->buckets[i] > 0) {
+      fprintf(out, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ", HistogramBucketValue(i),
+              h->buckets[i]);
+      first = 0;
     }
+  }
+  fprintf(out, "]}");
+}
 
-    printf("Content-Length: %d\n", bytes_received);
+void StatsWrite(FILE *out) {
+  fprintf(out, "{\n  \"elapsed_s\": %.6f,\n", MonotonicSeconds() - runStats.started);
+  fprintf(out,
+          "  \"counters\": {\"connections\": %" PRIu64 ", \"responses\": %" PRIu64
+          ", \"recv_calls\": %" PRIu64 ", \"bytes_received\": %" PRIu64
+          ", \"chunks\": %" PRIu64 ", \"chunk_bytes\": %" PRIu64 ", \"retries\": %" PRIu64
+          ", \"hedges\": %" PRIu64 "},\n",
+          runStats.connections, runStats.responses, runStats.recv_calls,
+          runStats.bytes_received, runStats.chunks, runStats.chunk_bytes, runStats.retries,
+          runStats.hedges);
+  fprintf(out, "  \"stages_ns\": {\n");
+  for (int i = 0; i < STAT_STAGES; i++) {
+    fprintf(out, "    \"%s\": ", statStageNames[i]);
+    StatsWriteHistogram(out, &runStats.stages[i]);
+    fprintf(out, "%s\n", i + 1 < STAT_STAGES ? "," : "");
   }
-  printf("End HEADER ..\n");
-  return bytes_received;
+  fprintf(out, "  }\n}\n");
 }
 
 /**
- * @brief Base64url decoding algorithm
- * @param[in] input Base64url-encoded string
- * @param[in] inputLen Length of the encoded string
- * @param[out] output Resulting decoded data
- * @param[out] outputLen Length of the decoded data
- * @return Error code
+ * @brief Write the stats out to --stats, or to stderr without it
+ *
+ * The file is written next to its final name and renamed over it, so
+ * whoever polls it never reads half a dump.
  **/
-// https://www.oryx-embedded.com/doc/base64url_8c_source.html
-int base64urlDecode(const char *input, int inputLen, char *output, int *outputLen) {
-  int error = 0;
-  int value;
-  int c;
-  int i;
-  int n;
-  uint8_t *ptr;
+void StatsDump(void) {
+  char tmp[1100];
+  FILE *out;
 
-  //Check the length of the input string
-  if((inputLen % 4) == 1) {
-    printf("invalid base64url length of a given chunk\n");
-    return 0;
+  if (statsPath == NULL) {
+    StatsWrite(stderr);
+    return;
   }
-
-  if(input == NULL && inputLen != 0) {
-    printf("(base64urlDecode) invalid input params\n");
+  if (strcmp(statsPath, "-") == 0) {
+    StatsWrite(statsOut);
+    fflush(statsOut);
+    return;
+  }
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", statsPath, (int)getpid());
+  if ((out = fopen(tmp, "w")) == NULL) {
+    perror("stats fopen");
+    return;
   }
+  StatsWrite(out);
+  if (fclose(out) != 0 || rename(tmp, statsPath) == -1) {
+    perror("stats write");
+    unlink(tmp);
+  }
+}
 
-  if(outputLen == NULL) {
-    printf("(base64urlDecode) invalid output params\n");
+/**
+ * @brief Take stdout over for a JSON output given as -
+ *
+ * Everything else printed goes to stderr from here on, so whoever reads
+ * stdout only gets the JSON.
+ *
+ * @return A stream on what was stdout
+ **/
+FILE *StdoutDetach(void) {
+  FILE *out;
+
+  fflush(stdout);
+  if ((out = fdopen(dup(STDOUT_FILENO), "w")) == NULL ||
+      dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+    perror("dup");
+    exit(1);
   }
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  return out;
+}
 
+void StatsSignal(int sig) {
+  (void)sig;
+  statsDumpRequested = 1;
+}
 
-  //Initialize status code
-  error = 1;
+/**
+ * @brief Dump the stats if a SIGUSR1 came in since the last call
+ *
+ * The handler only raises a flag, the fetch loops call this once per chunk.
+ **/
+void StatsPoll(void) {
+  if (statsDumpRequested) {
+    statsDumpRequested = 0;
+    StatsDump();
+  }
+}
 
-  //Point to the buffer where to write the decoded data
-  ptr = (uint8_t *) output;
+/**
+ * @brief Account a chunk handed to the parser
+ **/
+void StatsChunk(int len) {
+  runStats.chunks++;
+  runStats.chunk_bytes += len;
+  StatsPoll();
+}
 
-  //Initialize variables
-  n = 0;
-  value = 0;
+/**
+ * @brief Account a complete response
+ *
+ * Time to first byte counts from when the response became the next one due
+ * on its connection, so a pipelined request isn't charged for the
+ * responses queued ahead of it.
+ **/
+void StatsResponse(const struct HttpResponse *res) {
+  runStats.responses++;
+  if (res->first_byte > 0) {
+    StatsRecord(STAT_TTFB, res->first_byte - res->started);
+    StatsRecord(STAT_BODY, MonotonicSeconds() - res->first_byte);
+  }
+}
 
-  //Process the Base64url-encoded string
-  for(i = 0; i < inputLen && error == 1; i++) {
-    //Get current character
-    c = (char) input[i];
+/**
+ * Pool of the MAX_CHUNK_SIZE buffers chunks are received into. Buffers are
+ * page aligned, carved out of slabs that --hugepages backs with huge pages
+ * when the system has some to give, and go on a free list when released,
+ * so memory grows with the most chunks ever in flight at once. The lock
+ * makes the pool safe to share between threads.
+ **/
+struct ChunkPool {
+  pthread_mutex_t lock;
+  int hugepages;
+  // free buffers, the first bytes of each point at the next one
+  void *free;
+  void **slabs;
+  int slab_cnt;
+  int slab_cap;
+  int in_use;
+  int peak;
+};
 
-    //Check the value of the current character
-    if(c < 128 && base64urlDecTable[c] < 64) {
-      //Decode the current character
-      value = (value << 6) | base64urlDecTable[c];
+static struct ChunkPool chunkPool = {.lock = PTHREAD_MUTEX_INITIALIZER};
 
-      //Divide the input stream into blocks of 4 characters
-      if((i % 4) == 3) {
-        //Map each 4-character block to 3 bytes
-        if(output != NULL)
-          {
-            ptr[n] = (value >> 16) & 0xFF;
-            ptr[n + 1] = (value >> 8) & 0xFF;
-            ptr[n + 2] = value & 0xFF;
-          }
-        if (n < 32) {
-          printf("n: %d %d %d\n", n, ptr[n], (uint32_t) ((uint8_t) ptr[n]));
-        }
-        //Adjust the length of the decoded data
-        n += 3;
-        //Decode next block
-        value = 0;
-      }
-    }
-    else {
-      //Implementations must reject the encoded data if it contains
-      //characters outside the base alphabet
-      printf("invalid base64url char: '%i'\n", (int) c);
-      error = 0;
-    }
+/**
+ * @brief Map an anonymous slab aligned to a huge page
+ *
+ * Transparent huge pages only back aligned 2 MB ranges, so a bit more is
+ * mapped and the unaligned ends are given back.
+ **/
+char *ChunkPoolMapAligned(size_t len) {
+  char *map, *slab;
+  size_t head;
+
+  map = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (map == MAP_FAILED) {
+    return MAP_FAILED;
   }
+  slab = (char *)(((uintptr_t)map + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+  head = slab - map;
+  if (head > 0) {
+    munmap(map, head);
+  }
+  munmap(slab + len, HUGE_PAGE_SIZE - head);
+  return slab;
+}
 
-  //Check status code
-  if(!error) {
-    //All trailing pad characters are omitted in Base64url
-    if((inputLen % 4) == 2) {
-      //The last block contains only 1 byte
-      if(output != NULL) {
-        //Decode the last byte
-        ptr[n] = (value >> 4) & 0xFF;
-      }
-
-      //Adjust the length of the decoded data
-      n++;
+/**
+ * @brief Add a slab of buffers to the free list, the pool lock held
+ **/
+void ChunkPoolGrow(struct ChunkPool *pool) {
+  size_t len = (size_t)CHUNK_POOL_SLAB_BUFFERS * MAX_CHUNK_SIZE;
+  char *slab = MAP_FAILED;
+
+  if (pool->hugepages) {
+    // reserved huge pages first, transparent ones next
+    slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                -1, 0);
+    if (slab == MAP_FAILED && (slab = ChunkPoolMapAligned(len)) != MAP_FAILED) {
+      madvise(slab, len, MADV_HUGEPAGE);
     }
-    else if((inputLen % 4) == 3) {
-      //The last block contains only 2 bytes
-      if(output != NULL) {
-        //Decode the last two bytes
-        ptr[n] = (value >> 10) & 0xFF;
-        ptr[n + 1] = (value >> 2) & 0xFF;
-      }
+  }
+  if (slab == MAP_FAILED) {
+    slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (slab == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
 
-      //Adjust the length of the decoded data
-      n += 2;
-    }
-    else {
-      //No pad characters in this case
+  if (pool->slab_cnt == pool->slab_cap) {
+    pool->slab_cap = pool->slab_cap ? pool->slab_cap * 2 : 16;
+    if ((pool->slabs = realloc(pool->slabs, pool->slab_cap * sizeof(void *))) == NULL) {
+      perror("realloc");
+      exit(1);
     }
   }
+  pool->slabs[pool->slab_cnt++] = slab;
 
-  //Total number of bytes that have been written
-  /* printf("n %zi error %i inputlen %zu\n", n, error, inputLen); */
-  *outputLen = n;
-
-  //Return status code
-  return error;
+  for (int i = CHUNK_POOL_SLAB_BUFFERS - 1; i >= 0; i--) {
+    *(void **)(slab + (size_t)i * MAX_CHUNK_SIZE) = pool->free;
+    pool->free = slab + (size_t)i * MAX_CHUNK_SIZE;
+  }
 }
 
-int ProcessChunk(struct ArweaveNode *arNode,
-                 struct ArweaveBundle *arBundle,
-                 struct ArweaveBundleHeader *arBundleHeader,
-                 struct StateMachine *state,
-                 int encChunkSize,
-                 char* chunk_buffer) {
-  /* printf("\n\%s\n", chunk_buffer); */
-  /* int cnk_index = 0; */
-  printf("z-1 \n");
-  char buffer[MAX_CHUNK_SIZE * 4];
-  int decodedCnt = 0;
-  int thisCnt;
-  /* int  bufferIdx = 0; */
-  /* char buffer1[1024]; */
-  /* char buffer2[1024 * 4]; */
-  /* int  buffer2idx = 0; */
-  /* [state->chunk_buffer_index] */
-  /* printf("zero %c \n", chunk_buffer[0]); */
-
-  if (!base64urlDecode(chunk_buffer, encChunkSize, buffer, &thisCnt)) {
-    printf("Decode Failure\n");
-    exit(1);
-    return 1;
+char *ChunkPoolAcquire(struct ChunkPool *pool) {
+  char *buf;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->free == NULL) {
+    ChunkPoolGrow(pool);
+  }
+  buf = pool->free;
+  pool->free = *(void **)buf;
+  if (++pool->in_use > pool->peak) {
+    pool->peak = pool->in_use;
   }
+  pthread_mutex_unlock(&pool->lock);
+  return buf;
+}
 
-  /* printf("type: %d %x\n", (uint8_t) buffer[0]); */
-  /* printf("one %s %d %d\n", buffer, thisCnt, encChunkSize); */
-  /* printf("bytes: %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n", buffer[0* sizeof(uint8_t)], buffer[1* sizeof(uint8_t)], buffer[2* sizeof(uint8_t)], buffer[3* sizeof(uint8_t)], buffer[4* sizeof(uint8_t)], buffer[5* sizeof(uint8_t)], buffer[6* sizeof(uint8_t)], buffer[7* sizeof(uint8_t)], buffer[8* sizeof(uint8_t)], buffer[9* sizeof(uint8_t)], buffer[10* sizeof(uint8_t)], buffer[11* sizeof(uint8_t)], buffer[12* sizeof(uint8_t)], */
-  /*        buffer[13* sizeof(uint8_t)], buffer[14* sizeof(uint8_t)], buffer[15* sizeof(uint8_t)], buffer[16* sizeof(uint8_t)], buffer[17* sizeof(uint8_t)], buffer[18* sizeof(uint8_t)], buffer[19* sizeof(uint8_t)], buffer[20* sizeof(uint8_t)], buffer[21* sizeof(uint8_t)], buffer[22* sizeof(uint8_t)], buffer[23* sizeof(uint8_t)], buffer[24* sizeof(uint8_t)], buffer[25* sizeof(uint8_t)]); */
-  state->chunk_buffer_index += thisCnt;
+/**
+ * @brief Hand a buffer back to the pool, NULL is ignored
+ **/
+void ChunkPoolRelease(struct ChunkPool *pool, char *buf) {
+  if (buf == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  *(void **)buf = pool->free;
+  pool->free = buf;
+  pool->in_use--;
+  pthread_mutex_unlock(&pool->lock);
+}
 
-  if (state->di_cnt_done != 1 && state->chunk_buffer_index > 32) {
-    for(int i=0; i < 32; i++) {
+/**
+ * @brief Unmap every slab, all buffers have to be back
+ **/
+void ChunkPoolDestroy(struct ChunkPool *pool) {
+  if (verbose) {
+    printf("chunk buffers: %d mapped, %d in use at peak\n",
+           pool->slab_cnt * CHUNK_POOL_SLAB_BUFFERS, pool->peak);
+  }
+  for (int i = 0; i < pool->slab_cnt; i++) {
+    munmap(pool->slabs[i], (size_t)CHUNK_POOL_SLAB_BUFFERS * MAX_CHUNK_SIZE);
+  }
+  free(pool->slabs);
+  pool->slabs = NULL;
+  pool->slab_cnt = pool->slab_cap = 0;
+  pool->free = NULL;
+}
 
-      printf("i: %d val: %hhu %lu\n", i, (uint8_t) buffer[i * sizeof(uint8_t)], sizeof(uint8_t));
+void HttpResponseInit(struct HttpResponse *res, HttpBodyConsumer consumer, void *ctx) {
+  res->state = HTTP_STATUS_LINE;
+  res->status = 0;
+  res->content_length = -1;
+  res->chunked = 0;
+  res->keep_alive = 1;
+  res->remaining = 0;
+  res->body_len = 0;
+  res->recv_calls = 0;
+  res->started = MonotonicSeconds();
+  res->first_byte = 0;
+  res->line_len = 0;
+  res->consumer = consumer;
+  res->ctx = ctx;
+  res->direct = NULL;
+  res->direct_cap = 0;
+}
 
-      /* arBundleHeader->data_item_cnt += (uint8_t) &buffer[i * sizeof(uint8_t)]; */
+/**
+ * @brief Have the body land in place, without a consumer
+ *
+ * A Content-Length body is received straight into direct once whatever came
+ * in with the headers is copied over.
+ *
+ * @param[in] res Freshly initialised parser
+ * @param[out] direct Buffer the body is received into
+ * @param[in] cap Size of direct, a longer body fails the response
+ **/
+void HttpResponseDirect(struct HttpResponse *res, char *direct, int cap) {
+  res->direct = direct;
+  res->direct_cap = cap;
+}
 
-      /* arBundleHeader->data_item_cnt += strtol((uint8_t) &buffer[i * sizeof(uint8_t)], 0, 16); */
-      /* arBundleHeader->data_item_cnt <<= 4; */
-      /* arBundleHeader->data_item_cnt |= (uint32_t) buffer[i]; */
-    }
+int HttpHeaderIs(const char *line, const char *name) {
+  return strncasecmp(line, name, strlen(name)) == 0;
+}
 
-    /* arBundleHeader->data_item_cnt = 0; */
-    /* char dataItemCnt[3] = { 0 }; */
-    /* sprintf(dataItemCnt, "%2x", buffer[0]); */
-    /* arBundleHeader->data_item_cnt = strtol(dataItemCnt, 0, 16); */
-    /* arBundleHeader->data_item_cnt */
-    printf("333 %d \n", arBundleHeader->data_item_cnt);
-    /* arBundle->data_item_cnt */
+int HttpValueContains(const char *value, const char *token) {
+  int len = strlen(token);
 
-    /* for(int i=7; i>=0; i--) { */
-    /*   arBundleHeader->data_item_cnt <<= 4; */
-    /*   arBundleHeader->data_item_cnt |= (uint32_t) buffer[i]; */
-    /* } */
-    /* printf("data_item_cnt %d\n", arBundleHeader->data_item_cnt); */
-    state->di_cnt_done = 1;
+  for (; *value; value++) {
+    if (strncasecmp(value, token, len) == 0) {
+      return 1;
+    }
   }
-
   return 0;
-
 }
 
-int ProcessBundle(struct ArweaveNode *arNode,
-                  struct ArweaveBundle *arBundle,
-                  struct ArweaveBundleHeader *arBundleHeader,
-                  struct StateMachine *state) {
+/**
+ * @brief Act on one complete status, header, chunk-size or trailer line
+ * @return 0 on success, -1 when the node sent something we can't follow
+ **/
+int HttpLine(struct HttpResponse *res) {
+  char *line = res->line;
+  char *value;
 
-  int sock, contentlengh, status;
+  line[res->line_len] = 0;
+  res->line_len = 0;
 
-  // sizeof return annoying long int which we dont need
-  int chunk_buffer_len = MAX_CHUNK_SIZE * 4;
-  int page_buffer_len = MAX_CHUNK_SIZE * 8;
+  switch (res->state) {
+  case HTTP_STATUS_LINE:
+    if (sscanf(line, "HTTP/%*d.%*d %d", &res->status) != 1) {
+      return -1;
+    }
+    // HTTP/1.0 closes after every response unless told otherwise
+    res->keep_alive = strncmp(line, "HTTP/1.0", 8) != 0;
+    res->state = HTTP_HEADERS;
+    return 0;
 
-  struct sockaddr_in server_addr;
-  char chunk_buffer[chunk_buffer_len];
-  char page_buffer[page_buffer_len];
-  char send_data[1024];
-  char recv_data[1024];
-  char path[256];
+  case HTTP_HEADERS:
+    if (line[0] != 0) {
+      value = strchr(line, ':');
+      if (value == NULL) {
+        return -1;
+      }
+      for (value++; *value == ' ' || *value == '\t'; value++) {
+      }
+      if (HttpHeaderIs(line, "content-length:")) {
+        res->content_length = strtoll(value, NULL, 10);
+      } else if (HttpHeaderIs(line, "transfer-encoding:")) {
+        res->chunked = HttpValueContains(value, "chunked");
+      } else if (HttpHeaderIs(line, "connection:")) {
+        if (HttpValueContains(value, "close")) {
+          res->keep_alive = 0;
+        } else if (HttpValueContains(value, "keep-alive")) {
+          res->keep_alive = 1;
+        }
+      }
+      return 0;
+    }
 
-  // very crude jq for .chunk
-  const char *chunk_token = "\"chunk\"";
-  int json_token_chunk_start = -1;
-  int current_chunk_start = -1;
-  int current_chunk_end = -1;
-  int current_page_index = 0;
-  int bytes_received;
+    // blank line, the body starts right after it
+    if ((res->status >= 100 && res->status < 200) || res->status == 204 ||
+        res->status == 304) {
+      res->state = res->status < 200 ? HTTP_STATUS_LINE : HTTP_DONE;
+    } else if (res->chunked) {
+      res->state = HTTP_CHUNK_SIZE;
+    } else if (res->content_length >= 0) {
+      res->remaining = res->content_length;
+      res->state = res->remaining > 0 ? HTTP_BODY : HTTP_DONE;
+    } else {
+      // no length given, the body runs until the node closes
+      res->keep_alive = 0;
+      res->state = HTTP_BODY_UNTIL_CLOSE;
+    }
+    return 0;
 
-  state->chunk_buffer_index = 0;
-  state->iter_index = 0;
-  state->di_cnt_done = -1;
-  state->offset_done = -1;
-  state->header_done = -1;
+  case HTTP_CHUNK_SIZE:
+    res->remaining = strtoll(line, NULL, 16);
+    res->state = res->remaining > 0 ? HTTP_CHUNK_DATA : HTTP_TRAILERS;
+    return 0;
 
-  while (arBundle->currentOffset < arBundle->endOffset) {
+  case HTTP_CHUNK_CRLF:
+    res->state = HTTP_CHUNK_SIZE;
+    return 0;
 
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-      perror("Socket");
-      exit(1);
+  case HTTP_TRAILERS:
+    if (line[0] == 0) {
+      res->state = HTTP_DONE;
     }
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(arNode->port);
-    server_addr.sin_addr = *((struct in_addr *)arNode->host->h_addr);
-    bzero(&(server_addr.sin_zero), 8);
+    return 0;
+  }
+  return -1;
+}
 
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1) {
-      perror("Connect");
-      exit(1);
+/**
+ * @brief Feed bytes read off the socket to an incremental response parser
+ *
+ * Bytes can arrive in any slicing. Body bytes are handed to the consumer
+ * straight from data, and parsing stops right where the response ends, so
+ * whatever follows belongs to the next pipelined response.
+ *
+ * @param[in] res Parser state, set up by HttpResponseInit
+ * @param[in] data Bytes read off the socket
+ * @param[in] len Number of bytes in data
+ * @return Number of bytes consumed, -1 on a malformed response
+ **/
+int HttpFeed(struct HttpResponse *res, const char *data, int len) {
+  int used = 0;
+  int take;
+
+  while (used < len && res->state != HTTP_DONE) {
+    if (res->state == HTTP_BODY || res->state == HTTP_CHUNK_DATA ||
+        res->state == HTTP_BODY_UNTIL_CLOSE) {
+      take = len - used;
+      if (res->state != HTTP_BODY_UNTIL_CLOSE && res->remaining < take) {
+        take = res->remaining;
+      }
+      if (res->direct != NULL) {
+        if (res->body_len + take > res->direct_cap) {
+          return -1;
+        }
+        memcpy(res->direct + res->body_len, data + used, take);
+      } else if (res->consumer != NULL && res->consumer(res->ctx, data + used, take) == -1) {
+        return -1;
+      }
+      used += take;
+      res->body_len += take;
+      if (res->state != HTTP_BODY_UNTIL_CLOSE && (res->remaining -= take) == 0) {
+        res->state = res->state == HTTP_BODY ? HTTP_DONE : HTTP_CHUNK_CRLF;
+      }
+      continue;
     }
 
-    sprintf(path, "chunk/%" PRId64, arBundle->currentOffset);
-    snprintf(send_data, sizeof(send_data), "GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n",
-             path, arNode->domain);
-
-    if (send(sock, send_data, strlen(send_data), 0) == -1) {
-      perror("send");
-      exit(2);
+    // line oriented states
+    const char *eol = memchr(data + used, '\n', len - used);
+    take = (eol ? eol - (data + used) : len - used);
+    if (res->line_len + take >= HTTP_MAX_LINE) {
+      return -1;
     }
+    memcpy(res->line + res->line_len, data + used, take);
+    res->line_len += take;
+    used += take;
+    if (eol) {
+      used++;
+      if (res->line_len > 0 && res->line[res->line_len - 1] == '\r') {
+        res->line_len--;
+      }
+      if (HttpLine(res) == -1) {
+        return -1;
+      }
+    }
+  }
+  return used;
+}
 
-    status = ReadHttpStatus(sock);
-    if (status >= 400 && status < 500) {
-      fprintf(stderr, "chunk offset %" PRId64 "wasn't found\n", arBundle->currentOffset);
-      exit(EXIT_FAILURE);
+/**
+ * @brief Read more of a response off the socket
+ * @param[in] sock Socket the request went out on
+ * @param[in] rd Read buffer of the connection, may hold a previous leftover
+ * @param[in] res Parser of the response being read
+ * @return 1 once the response is complete, 0 when a non-blocking socket
+ *         has nothing more for now, -1 if the node hung up or sent garbage
+ **/
+int HttpPump(int sock, struct HttpReader *rd, struct HttpResponse *res) {
+  int used, bytes_received;
+
+  for (;;) {
+    if (rd->start < rd->end) {
+      if (res->first_byte == 0) {
+        res->first_byte = MonotonicSeconds();
+      }
+      if ((used = HttpFeed(res, rd->buf + rd->start, rd->end - rd->start)) == -1) {
+        return -1;
+      }
+      rd->start += used;
+      if (res->state == HTTP_DONE) {
+        return 1;
+      }
     }
-    contentlengh = ParseHeader(sock);
 
-    while ((bytes_received = recv(sock, recv_data, 1024, 0))) {
-      printf("%d bytes received\n", bytes_received);
-      printf("%d total bytes received\n", current_page_index);
+    rd->start = rd->end = 0;
 
+    if (res->direct != NULL && res->state == HTTP_BODY) {
+      // nothing buffered, receive the rest of the body in place
+      if (res->body_len + res->remaining > res->direct_cap) {
+        return -1;
+      }
+      bytes_received = recv(sock, res->direct + res->body_len, res->remaining, 0);
+      res->recv_calls++;
+      runStats.recv_calls++;
       if (bytes_received == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return 0;
+        }
         perror("recieve");
-        exit(3);
+        return -1;
       }
-      memcpy(page_buffer + current_page_index, recv_data, bytes_received);
-
-      if (json_token_chunk_start < 0 || current_chunk_start < 0 || current_chunk_end < 0) {
-        for (int c = 0; c < bytes_received; c++) {
-          if (json_token_chunk_start < 0) {
-            if (strncmp(chunk_token, &recv_data[c], 7) == 0) {
-              json_token_chunk_start = current_page_index + c;
-            }
-          } else if (((7 + current_page_index - current_chunk_start) > c) && current_chunk_start < 0) {
-            if (recv_data[c] == '"' ) {
-              current_chunk_start = current_page_index + c + 3;
-            }
-          } else if (((1 + current_page_index - current_chunk_start) > c) && current_chunk_end < 0) {
-            if (recv_data[c] == '"' ) {
-              current_chunk_end = current_page_index + c;
-            }
-          }
-        }
+      if (bytes_received == 0) {
+        return -1;
       }
-
-      if (json_token_chunk_start > -1 && current_chunk_start > -1 && current_chunk_end > -1) {
-        int encChunkSize = current_chunk_end - current_chunk_start;
-        if (((encChunkSize + state->chunk_buffer_index) % page_buffer_len) == (encChunkSize + state->chunk_buffer_index)) {
-          memcpy(chunk_buffer + state->chunk_buffer_index, page_buffer + current_chunk_start, encChunkSize);
-        } else {
-          printf("not same size %d %d\n", ((encChunkSize + state->chunk_buffer_index) % page_buffer_len), (encChunkSize + state->chunk_buffer_index));
-          memcpy(chunk_buffer + state->chunk_buffer_index, page_buffer + current_chunk_start,
-                 page_buffer_len - state->chunk_buffer_index);
-          memcpy(chunk_buffer, &page_buffer[current_chunk_start],
-                 (encChunkSize + state->chunk_buffer_index) % page_buffer_len);
-        }
-        printf("chunk buffer %s \n first char %c \n", chunk_buffer, chunk_buffer[0]);
-        ProcessChunk(arNode, arBundle, arBundleHeader, state, encChunkSize, chunk_buffer);
+      runStats.bytes_received += bytes_received;
+      res->body_len += bytes_received;
+      if ((res->remaining -= bytes_received) == 0) {
+        res->state = HTTP_DONE;
+        return 1;
       }
+      continue;
+    }
 
-      if (current_page_index >= contentlengh ||
-          (json_token_chunk_start > -1 && current_chunk_start > -1 && current_chunk_end > -1)) {
-        close(sock);
-        json_token_chunk_start = -1;
-        current_chunk_start = -1;
-        current_chunk_end = -1;
-        current_page_index = 0;
-        break;
-      } else {
-        current_page_index += bytes_received;
+    bytes_received = recv(sock, rd->buf, HTTP_READ_BUFFER_SIZE, 0);
+    res->recv_calls++;
+    runStats.recv_calls++;
+    if (bytes_received == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
       }
-
-      printf("json_token_chunk_start: %d current_chunk_start: %d current_chunk_end: %d\n",
-             json_token_chunk_start, current_chunk_start, current_chunk_end);
+      perror("recieve");
+      return -1;
     }
-    exit(0);
-    break;
+    if (bytes_received == 0) {
+      if (res->state == HTTP_BODY_UNTIL_CLOSE) {
+        res->state = HTTP_DONE;
+        return 1;
+      }
+      return -1;
+    }
+    runStats.bytes_received += bytes_received;
+    rd->end = bytes_received;
   }
+}
 
+int PageSinkWrite(void *ctx, const char *data, int len) {
+  struct PageSink *sink = (struct PageSink *)ctx;
 
+  if (sink->len + len > sink->cap) {
+    sink->overflow = 1;
+    return -1;
+  }
+  memcpy(sink->page + sink->len, data, len);
+  sink->len += len;
   return 0;
+}
+
+void HttpReaderInit(struct HttpReader *rd) {
+  if ((rd->buf = malloc(HTTP_READ_BUFFER_SIZE)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  rd->start = rd->end = 0;
+}
 
+void HttpReaderFree(struct HttpReader *rd) {
+  free(rd->buf);
+  rd->buf = NULL;
+  rd->start = rd->end = 0;
 }
 
-int GetOffsetAndSize(struct ArweaveNode *arNode,
-                     struct ArweaveBundle *arBundle) {
+void NodeAddress(struct ArweaveNode *arNode, struct sockaddr_in *server_addr) {
+  server_addr->sin_family = AF_INET;
+  server_addr->sin_port = htons(arNode->port);
+  server_addr->sin_addr = arNode->addr;
+  bzero(&(server_addr->sin_zero), 8);
+}
+
+void PoolConnectionOpened(struct ArweaveNode *arNode) {
+  pthread_mutex_lock(&arNode->pool.lock);
+  arNode->pool.connections_opened++;
+  pthread_mutex_unlock(&arNode->pool.lock);
+  runStats.connections++;
+}
 
+/**
+ * @brief Connect a blocking socket to the node
+ * @return Socket, -1 when the node can't be reached; sending on a connection
+ *         left with sock -1 fails like one the node hung up on
+ **/
+int OpenConnection(struct ArweaveNode *arNode) {
   int sock;
   struct sockaddr_in server_addr;
-  jsmn_parser parser;
-  jsmntok_t tokens[2048];
-  int parseResult;
-  /* int bytes_received; */
+  double started;
+
+  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    perror("Socket");
+    return -1;
+  }
+  NodeAddress(arNode, &server_addr);
+
+  started = MonotonicSeconds();
+  if (connect(sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1) {
+    perror("Connect");
+    close(sock);
+    return -1;
+  }
+  StatsRecord(STAT_CONNECT, MonotonicSeconds() - started);
+
+  PoolConnectionOpened(arNode);
+  return sock;
+}
+
+void PoolInit(struct ArweaveNode *arNode) {
+  pthread_mutex_init(&arNode->pool.lock, NULL);
+  arNode->pool.idle_cnt = 0;
+  arNode->pool.connections_opened = 0;
+  arNode->pool.requests_served = 0;
+  arNode->pool.recv_calls = 0;
+}
+
+/**
+ * @brief Take a connection to the node out of its keep-alive pool
+ * @param[in] arNode Node to talk to
+ * @return Idle connection if there is one, otherwise a freshly connected one
+ **/
+int PoolTakeIdle(struct ArweaveNode *arNode) {
+  int sock = -1;
+
+  pthread_mutex_lock(&arNode->pool.lock);
+  if (arNode->pool.idle_cnt > 0) {
+    sock = arNode->pool.idle[--arNode->pool.idle_cnt];
+  }
+  pthread_mutex_unlock(&arNode->pool.lock);
+  return sock;
+}
+
+struct ArweaveConnection PoolAcquire(struct ArweaveNode *arNode) {
+  struct ArweaveConnection conn;
+
+  conn.sock = PoolTakeIdle(arNode);
+  conn.reused = conn.sock >= 0;
+  if (!conn.reused) {
+    conn.sock = OpenConnection(arNode);
+  }
+  HttpReaderInit(&conn.rd);
+  return conn;
+}
+
+/**
+ * @brief Hand a connection back to the pool
+ * @param[in] arNode Node the connection belongs to
+ * @param[in] conn Connection with no unread responses left on it
+ * @param[in] reusable 0 when the node asked to close or the stream is out of sync
+ **/
+void PoolRelease(struct ArweaveNode *arNode, struct ArweaveConnection *conn, int reusable) {
+  // bytes of a response nobody asked for mean the stream is out of sync
+  if (conn->rd.start < conn->rd.end) {
+    reusable = 0;
+  }
+  // the buffer is there even when the connect failed
+  HttpReaderFree(&conn->rd);
+  if (conn->sock < 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&arNode->pool.lock);
+  if (reusable && arNode->pool.idle_cnt < MAX_POOL_CONNECTIONS) {
+    arNode->pool.idle[arNode->pool.idle_cnt++] = conn->sock;
+    reusable = 1;
+  } else {
+    reusable = 0;
+  }
+  pthread_mutex_unlock(&arNode->pool.lock);
+
+  if (!reusable) {
+    close(conn->sock);
+  }
+  conn->sock = -1;
+}
+
+void PoolRequestServed(struct ArweaveNode *arNode, const struct HttpResponse *res) {
+  pthread_mutex_lock(&arNode->pool.lock);
+  arNode->pool.requests_served++;
+  arNode->pool.recv_calls += res->recv_calls;
+  pthread_mutex_unlock(&arNode->pool.lock);
+  StatsResponse(res);
+}
+
+void PoolDestroy(struct ArweaveNode *arNode) {
+  while (arNode->pool.idle_cnt > 0) {
+    close(arNode->pool.idle[--arNode->pool.idle_cnt]);
+  }
+  printf("connections opened: %" PRIu64 " requests served: %" PRIu64 "\n",
+         arNode->pool.connections_opened, arNode->pool.requests_served);
+  if (arNode->pool.requests_served > 0) {
+    printf("recv calls: %" PRIu64 " (%.1f per response)\n", arNode->pool.recv_calls,
+           (double)arNode->pool.recv_calls / arNode->pool.requests_served);
+  }
+  if (arNode->stats.samples > 0) {
+    printf("%s:%d latency %.1f ms p95 %.1f ms throughput %.1f MB/sec hedges sent: %" PRIu64
+           " won: %" PRIu64 "\n", arNode->domain, arNode->port, arNode->stats.latency * 1000,
+           arNode->stats.p95 * 1000, arNode->stats.throughput / 1e6,
+           arNode->stats.hedges_sent, arNode->stats.hedges_won);
+  }
+  pthread_mutex_destroy(&arNode->pool.lock);
+}
+
+static int DoubleCompare(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Account a finished chunk request to its node
+ * @param[in] secs Time from writing the request to the end of the response
+ * @param[in] bytes Body length, 0 for a request given up on
+ **/
+void NodeStatsSample(struct ArweaveNode *arNode, double secs, int bytes) {
+  struct NodeStats *stats = &arNode->stats;
+  double sorted[NODE_LATENCY_SAMPLES];
+  int n;
+
+  if (stats->samples == 0) {
+    stats->latency = secs;
+  } else {
+    stats->latency += 0.2 * (secs - stats->latency);
+  }
+  if (bytes > 0 && secs > 0) {
+    if (stats->throughput == 0) {
+      stats->throughput = bytes / secs;
+    } else {
+      stats->throughput += 0.2 * (bytes / secs - stats->throughput);
+    }
+  }
+  stats->recent[stats->samples % NODE_LATENCY_SAMPLES] = secs;
+  stats->samples++;
+
+  n = stats->samples < NODE_LATENCY_SAMPLES ? stats->samples : NODE_LATENCY_SAMPLES;
+  memcpy(sorted, stats->recent, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), DoubleCompare);
+  stats->p95 = sorted[n * 95 / 100];
+}
+
+/**
+ * @brief Write a GET request for path, with a Range header unless range is NULL
+ * @return Length of the request
+ **/
+int FormatRequest(struct ArweaveNode *arNode, const char *path, const char *range,
+                  char *send_data, int len) {
+  if (range != NULL) {
+    return snprintf(send_data, len,
+                    "GET /%s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%s\r\n"
+                    "Connection: keep-alive\r\n\r\n",
+                    path, arNode->domain, range);
+  }
+  return snprintf(send_data, len,
+                  "GET /%s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                  path, arNode->domain);
+}
+
+/**
+ * @brief Write the request for the bundle bytes starting at a weave offset
+ *
+ * Raw requests ask for the MAX_CHUNK_SIZE bytes from there, clamped to the
+ * end of the bundle, so the node answers with exactly the bytes to parse.
+ **/
+int FormatChunkRequest(struct ArweaveNode *arNode, struct ArweaveBundle *arBundle,
+                       uint64_t offset, char *send_data, int len) {
+  char path[300];
+  char range[64];
+  uint64_t first, last;
+
+  if (!arBundle->raw) {
+    sprintf(path, "chunk/%" PRId64, offset);
+    return FormatRequest(arNode, path, NULL, send_data, len);
+  }
+  first = offset - arBundle->startOffset;
+  last = first + MAX_CHUNK_SIZE - 1;
+  if (last >= arBundle->size) {
+    last = arBundle->size - 1;
+  }
+  sprintf(path, "raw/%s", arBundle->tx_id);
+  sprintf(range, "%" PRIu64 "-%" PRIu64, first, last);
+  return FormatRequest(arNode, path, range, send_data, len);
+}
+
+int SendData(struct ArweaveConnection *conn, const char *send_data, int len) {
+  if (send(conn->sock, send_data, len, MSG_NOSIGNAL) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+int SendRequest(struct ArweaveNode *arNode, struct ArweaveConnection *conn, const char *path) {
   char send_data[1024];
-  char recv_data[1024];
-  char path[256] = "tx/";
+  int len = FormatRequest(arNode, path, NULL, send_data, sizeof(send_data));
 
-  strcat(path, arBundle->tx_id);
-  strcat(path, "/offset");
-  printf("path: %s\n", path);
+  return SendData(conn, send_data, len);
+}
+
+int SendChunkRequest(struct ArweaveNode *arNode, struct ArweaveConnection *conn,
+                     struct ArweaveBundle *arBundle, uint64_t offset) {
+  char send_data[1024];
+  int len = FormatChunkRequest(arNode, arBundle, offset, send_data, sizeof(send_data));
+
+  return SendData(conn, send_data, len);
+}
+
+/**
+ * @brief Read one whole response off a blocking connection
+ * @param[in] arNode Node the connection belongs to
+ * @param[in] conn Connection with the request already written
+ * @param[out] res Parsed response, body bytes go to its consumer
+ * @return HTTP status, 0 when the node hung up or sent garbage
+ **/
+int ReadResponse(struct ArweaveNode *arNode, struct ArweaveConnection *conn,
+                 struct HttpResponse *res) {
+  if (HttpPump(conn->sock, &conn->rd, res) != 1) {
+    return 0;
+  }
+  PoolRequestServed(arNode, res);
+  if (verbose) {
+    printf("status=%d body=%" PRId64 "\n", res->status, res->body_len);
+  }
+  return res->status;
+}
+
+/**
+ * @brief Base64url decoding algorithm
+ * @param[in] input Base64url-encoded string
+ * @param[in] inputLen Length of the encoded string
+ * @param[out] output Resulting decoded data
+ * @param[out] outputLen Length of the decoded data
+ * @return Error code
+ **/
+// https://www.oryx-embedded.com/doc/base64url_8c_source.html
+int base64urlDecodeScalar(const char *input, int inputLen, char *output, int *outputLen) {
+  int error = 0;
+  int value;
+  int c;
+  int i;
+  int n;
+  uint8_t *ptr;
+
+  //Check the length of the input string
+  if((inputLen % 4) == 1) {
+    printf("invalid base64url length of a given chunk\n");
+    return 0;
+  }
+
+  if(input == NULL && inputLen != 0) {
+    printf("(base64urlDecodeScalar) invalid input params\n");
+  }
+
+  if(outputLen == NULL) {
+    printf("(base64urlDecodeScalar) invalid output params\n");
+  }
+
+
+  //Initialize status code
+  error = 1;
+
+  //Point to the buffer where to write the decoded data
+  ptr = (uint8_t *) output;
+
+  //Initialize variables
+  n = 0;
+  value = 0;
+
+  //Process the Base64url-encoded string
+  for(i = 0; i < inputLen && error == 1; i++) {
+    //Get current character
+    c = (uint8_t) input[i];
+
+    //Check the value of the current character
+    if(c < 128 && base64urlDecTable[c] < 64) {
+      //Decode the current character
+      value = (value << 6) | base64urlDecTable[c];
+
+      //Divide the input stream into blocks of 4 characters
+      if((i % 4) == 3) {
+        //Map each 4-character block to 3 bytes
+        if(output != NULL)
+          {
+            ptr[n] = (value >> 16) & 0xFF;
+            ptr[n + 1] = (value >> 8) & 0xFF;
+            ptr[n + 2] = value & 0xFF;
+          }
+        //Adjust the length of the decoded data
+        n += 3;
+        //Decode next block
+        value = 0;
+      }
+    }
+    else {
+      //Implementations must reject the encoded data if it contains
+      //characters outside the base alphabet
+      printf("invalid base64url char: '%i'\n", (int) c);
+      error = 0;
+    }
+  }
+
+  //Check status code
+  if(error) {
+    //All trailing pad characters are omitted in Base64url
+    if((inputLen % 4) == 2) {
+      //The last block contains only 1 byte
+      if(output != NULL) {
+        //Decode the last byte
+        ptr[n] = (value >> 4) & 0xFF;
+      }
+
+      //Adjust the length of the decoded data
+      n++;
+    }
+    else if((inputLen % 4) == 3) {
+      //The last block contains only 2 bytes
+      if(output != NULL) {
+        //Decode the last two bytes
+        ptr[n] = (value >> 10) & 0xFF;
+        ptr[n + 1] = (value >> 2) & 0xFF;
+      }
+
+      //Adjust the length of the decoded data
+      n += 2;
+    }
+    else {
+      //No pad characters in this case
+    }
+  }
+
+  //Total number of bytes that have been written
+  /* printf("n %zi error %i inputlen %zu\n", n, error, inputLen); */
+  *outputLen = n;
+
+  //Return status code
+  return error;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * Vectorised base64url decoding after Mula & Lemire, "Faster Base64
+ * Encoding and Decoding using AVX2 Instructions". Every byte is classified
+ * by range ('A'-'Z', 'a'-'z', '0'-'9', '-', '_') to get its 6 bit value,
+ * anything outside those ranges makes the kernel stop and leave the block
+ * to the scalar decoder, which reports it. The 6 bit values are then packed
+ * 4 -> 3 with two multiply-adds and a byte shuffle.
+ *
+ * Kernels only touch whole 4 character quanta and return how many input
+ * characters they consumed. Stores run a few bytes past the decoded data,
+ * so they stop well before the end of the input.
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i base64urlValuesSsse3(__m128i v, int *valid) {
+  const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+  const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  const __m128i dash = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+  const __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  __m128i shift;
+
+  shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+  shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+  shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+  shift = _mm_or_si128(shift, _mm_and_si128(dash, _mm_set1_epi8(62 - '-')));
+  shift = _mm_or_si128(shift, _mm_and_si128(underscore, _mm_set1_epi8(63 - '_')));
+
+  *valid = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower),
+                                          _mm_or_si128(_mm_or_si128(digit, dash), underscore)));
+  return _mm_add_epi8(v, shift);
+}
+
+__attribute__((target("ssse3")))
+static int base64urlDecodeSsse3(const char *input, int inputLen, uint8_t *output) {
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  int i = 0;
+  int valid;
+
+  for (; i + 32 <= inputLen; i += 16, output += 12) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(input + i));
+    v = base64urlValuesSsse3(v, &valid);
+    if (valid != 0xFFFF) {
+      break;
+    }
+    v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)output, _mm_shuffle_epi8(v, pack));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int base64urlDecodeAvx2(const char *input, int inputLen, uint8_t *output) {
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  int i = 0;
+
+  for (; i + 64 <= inputLen; i += 32, output += 24) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(input + i));
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i dash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'));
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    __m256i shift;
+
+    if ((uint32_t)_mm256_movemask_epi8(
+          _mm256_or_si256(_mm256_or_si256(upper, lower),
+                          _mm256_or_si256(_mm256_or_si256(digit, dash), underscore))) != 0xFFFFFFFFu) {
+      break;
+    }
+
+    shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(dash, _mm256_set1_epi8(62 - '-')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_')));
+    v = _mm256_add_epi8(v, shift);
+
+    v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+    v = _mm256_shuffle_epi8(v, pack);
+    _mm256_storeu_si256((__m256i *)output, _mm256_permutevar8x32_epi32(v, lanes));
+  }
+  return i;
+}
+
+#endif
+
+typedef int (*Base64urlKernel)(const char *input, int inputLen, uint8_t *output);
+
+static Base64urlKernel base64urlKernel;
+static const char *base64urlKernelName = "scalar";
+
+static int base64urlDecodeNone(const char *input, int inputLen, uint8_t *output) {
+  (void)input;
+  (void)inputLen;
+  (void)output;
+  return 0;
+}
+
+/**
+ * @brief Pick the widest base64url kernel the CPU can run, once per process
+ **/
+void base64urlSelectKernel(void) {
+  base64urlKernel = base64urlDecodeNone;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    base64urlKernel = base64urlDecodeAvx2;
+    base64urlKernelName = "avx2";
+  } else if (__builtin_cpu_supports("ssse3")) {
+    base64urlKernel = base64urlDecodeSsse3;
+    base64urlKernelName = "ssse3";
+  }
+#endif
+}
+
+/**
+ * @brief Base64url decoding, vectorised where the CPU allows
+ *
+ * Same contract as base64urlDecodeScalar: the SIMD kernel decodes the bulk
+ * of the input and the scalar routine takes over for the tail and for any
+ * block holding a character outside the alphabet.
+ **/
+int base64urlDecode(const char *input, int inputLen, char *output, int *outputLen) {
+  int done, tailLen;
+
+  if (base64urlKernel == NULL) {
+    base64urlSelectKernel();
+  }
+  if ((inputLen % 4) == 1 || output == NULL) {
+    return base64urlDecodeScalar(input, inputLen, output, outputLen);
+  }
+
+  done = base64urlKernel(input, inputLen, (uint8_t *)output);
+  if (!base64urlDecodeScalar(input + done, inputLen - done, output + done / 4 * 3, &tailLen)) {
+    return 0;
+  }
+  *outputLen = done / 4 * 3 + tailLen;
+  return 1;
+}
+
+/**
+ * Resumable base64url decoder. Text can be fed in any slicing, a partial
+ * 4 character quantum is carried over to the next call.
+ **/
+struct Base64urlStream {
+  char carry[4];
+  int carry_len;
+};
+
+void base64urlStreamInit(struct Base64urlStream *st) {
+  st->carry_len = 0;
+}
+
+/**
+ * @brief Decode the next slice of base64url text
+ * @param[in] st Decoder state
+ * @param[in] input Next slice of text
+ * @param[in] inputLen Length of the slice
+ * @param[out] output Receives up to (carry + inputLen) / 4 * 3 bytes
+ * @return Number of bytes written, -1 on a character outside the alphabet
+ **/
+int base64urlStreamUpdate(struct Base64urlStream *st, const char *input, int inputLen,
+                          char *output) {
+  int n = 0;
+  int bulk, decoded;
+
+  if (st->carry_len > 0) {
+    while (st->carry_len < 4 && inputLen > 0) {
+      st->carry[st->carry_len++] = *input++;
+      inputLen--;
+    }
+    if (st->carry_len < 4) {
+      return 0;
+    }
+    if (!base64urlDecodeScalar(st->carry, 4, output, &decoded)) {
+      return -1;
+    }
+    n += decoded;
+    st->carry_len = 0;
+  }
+
+  bulk = inputLen - inputLen % 4;
+  if (bulk > 0) {
+    if (!base64urlDecode(input, bulk, output + n, &decoded)) {
+      return -1;
+    }
+    n += decoded;
+  }
+
+  memcpy(st->carry, input + bulk, inputLen - bulk);
+  st->carry_len = inputLen - bulk;
+  return n;
+}
+
+/**
+ * @brief Flush the unpadded 2 or 3 character tail once the text ended
+ * @return Number of bytes written, -1 if the text length was invalid
+ **/
+int base64urlStreamFinal(struct Base64urlStream *st, char *output) {
+  int decoded = 0;
+
+  if (st->carry_len > 0 && !base64urlDecodeScalar(st->carry, st->carry_len, output, &decoded)) {
+    return -1;
+  }
+  st->carry_len = 0;
+  return decoded;
+}
+
+static const char base64urlEncTable[64] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/**
+ * @brief Base64url encoding without padding
+ * @param[in] input Data to encode
+ * @param[in] inputLen Length of the data
+ * @param[out] output Receives (inputLen * 4 + 2) / 3 characters plus a NUL
+ * @return Number of characters written
+ **/
+int base64urlEncode(const uint8_t *input, int inputLen, char *output) {
+  int n = 0;
+  int i;
+
+  for (i = 0; i + 3 <= inputLen; i += 3) {
+    uint32_t value = (input[i] << 16) | (input[i + 1] << 8) | input[i + 2];
+    output[n++] = base64urlEncTable[(value >> 18) & 0x3F];
+    output[n++] = base64urlEncTable[(value >> 12) & 0x3F];
+    output[n++] = base64urlEncTable[(value >> 6) & 0x3F];
+    output[n++] = base64urlEncTable[value & 0x3F];
+  }
+  if (inputLen - i == 1) {
+    output[n++] = base64urlEncTable[input[i] >> 2];
+    output[n++] = base64urlEncTable[(input[i] & 0x03) << 4];
+  } else if (inputLen - i == 2) {
+    output[n++] = base64urlEncTable[input[i] >> 2];
+    output[n++] = base64urlEncTable[((input[i] & 0x03) << 4) | (input[i + 1] >> 4)];
+    output[n++] = base64urlEncTable[(input[i + 1] & 0x0F) << 2];
+  }
+  output[n] = 0;
+  return n;
+}
+
+/*
+ * SHA-256 (FIPS 180-4) for checking chunk proofs. The block function is
+ * picked once per process like the base64url kernels: the SHA extensions
+ * where the CPU has them, portable C otherwise.
+ */
+
+static const uint32_t sha256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Sha256BlocksScalar(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+
+  while (blocks-- > 0) {
+    for (int i = 0; i < 16; i++) {
+      w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+             (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+      w[i] = w[i - 16] + w[i - 7] +
+             (SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+             (SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+    }
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    for (int i = 0; i < 64; i++) {
+      t1 = h + (SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25)) +
+           ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+      t2 = (SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22)) +
+           ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+    data += 64;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * The SHA extensions keep the state as ABEF and CDGH and run two rounds
+ * per sha256rnds2; the message schedule is four words at a time with
+ * sha256msg1/sha256msg2.
+ */
+__attribute__((target("sha,sse4.1")))
+static void Sha256BlocksShaNi(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, abef, cdgh, tmp, msg;
+  __m128i w[4];
+
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  while (blocks-- > 0) {
+    abef = state0;
+    cdgh = state1;
+    // unrolled, so w[] lives in registers
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+      if (i < 4) {
+        w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+      } else {
+        // w[i % 4] holds words i - 4, the others the three groups after it
+        tmp = _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4);
+        w[i % 4] = _mm_sha256msg2_epu32(
+          _mm_add_epi32(_mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]), tmp), w[(i + 3) % 4]);
+      }
+      msg = _mm_add_epi32(w[i % 4], _mm_loadu_si128((const __m128i *)&sha256K[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#endif
+
+typedef void (*Sha256Kernel)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+static Sha256Kernel sha256Kernel;
+static const char *sha256KernelName = "scalar";
+
+/**
+ * @brief Pick the SHA-256 block function, once per process
+ **/
+void Sha256SelectKernel(void) {
+  sha256Kernel = Sha256BlocksScalar;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+    sha256Kernel = Sha256BlocksShaNi;
+    sha256KernelName = "sha-ni";
+  }
+#endif
+}
+
+/**
+ * @brief SHA-256 digest of len bytes
+ **/
+void Sha256(const void *data, size_t len, uint8_t digest[32]) {
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint8_t tail[128];
+  size_t whole = len / 64;
+  size_t rest = len % 64;
+  size_t tailLen = rest < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)len * 8;
+
+  if (sha256Kernel == NULL) {
+    Sha256SelectKernel();
+  }
+  sha256Kernel(state, data, whole);
+
+  memcpy(tail, (const uint8_t *)data + whole * 64, rest);
+  tail[rest] = 0x80;
+  memset(tail + rest + 1, 0, tailLen - rest - 1);
+  for (int i = 0; i < 8; i++) {
+    tail[tailLen - 1 - i] = bits >> (8 * i);
+  }
+  sha256Kernel(state, tail, tailLen / 64);
+
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i] = state[i] >> 24;
+    digest[4 * i + 1] = state[i] >> 16;
+    digest[4 * i + 2] = state[i] >> 8;
+    digest[4 * i + 3] = state[i];
+  }
+}
+
+/**
+ * @brief Backoff before retry number attempt, with full jitter so clients
+ *        that failed together don't come back together
+ **/
+double RetryDelay(int attempt) {
+  double cap = RETRY_BASE_DELAY * (double)(1ULL << (attempt < 20 ? attempt - 1 : 19));
+
+  if (cap > RETRY_MAX_DELAY) {
+    cap = RETRY_MAX_DELAY;
+  }
+  return cap * ((double)random() / ((double)RAND_MAX + 1));
+}
+
+void RetryWait(int attempt) {
+  double delay = RetryDelay(attempt);
+  struct timespec ts;
+
+  fprintf(stderr, "attempt %d of %d failed, retrying in %.2f s\n", attempt, MAX_FETCH_ATTEMPTS,
+          delay);
+  runStats.retries++;
+  ts.tv_sec = (time_t)delay;
+  ts.tv_nsec = (long)((delay - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Whether asking again may get a different answer
+ * @param[in] status HTTP status, 0 for a network error
+ **/
+int RetryableStatus(int status) {
+  return status == 0 || status == 408 || status == 429 || status >= 500;
+}
+
+/**
+ * @brief --bench-base64: decode throughput on chunk sized inputs
+ **/
+int BenchBase64(void) {
+  const int iterations = 2000;
+  uint8_t *raw = malloc(MAX_CHUNK_SIZE);
+  char *encoded = malloc(MAX_CHUNK_SIZE * 4 / 3 + 4);
+  char *decoded = malloc(MAX_CHUNK_SIZE + 64);
+  int encodedLen, decodedLen;
+  double start, scalarSecs, simdSecs;
+
+  srand(1984);
+  for (int i = 0; i < MAX_CHUNK_SIZE; i++) {
+    raw[i] = rand() & 0xFF;
+  }
+  encodedLen = base64urlEncode(raw, MAX_CHUNK_SIZE, encoded);
+  base64urlSelectKernel();
+
+  start = MonotonicSeconds();
+  for (int i = 0; i < iterations; i++) {
+    base64urlDecodeScalar(encoded, encodedLen, decoded, &decodedLen);
+  }
+  scalarSecs = MonotonicSeconds() - start;
+  if (decodedLen != MAX_CHUNK_SIZE || memcmp(decoded, raw, MAX_CHUNK_SIZE) != 0) {
+    fprintf(stderr, "scalar decoder mismatch\n");
+    return EXIT_FAILURE;
+  }
+
+  memset(decoded, 0, MAX_CHUNK_SIZE);
+  start = MonotonicSeconds();
+  for (int i = 0; i < iterations; i++) {
+    base64urlDecode(encoded, encodedLen, decoded, &decodedLen);
+  }
+  simdSecs = MonotonicSeconds() - start;
+  if (decodedLen != MAX_CHUNK_SIZE || memcmp(decoded, raw, MAX_CHUNK_SIZE) != 0) {
+    fprintf(stderr, "%s decoder mismatch\n", base64urlKernelName);
+    return EXIT_FAILURE;
+  }
+
+  printf("base64url decode, %d chunks of %d encoded bytes\n", iterations, encodedLen);
+  printf("  scalar: %.3f GB/s\n", (double)encodedLen * iterations / scalarSecs / 1e9);
+  printf("  %s: %.3f GB/s\n", base64urlKernelName,
+         (double)encodedLen * iterations / simdSecs / 1e9);
+
+  free(raw);
+  free(encoded);
+  free(decoded);
+  return EXIT_SUCCESS;
+}
+
+void BundleHeaderInit(struct ArweaveBundleHeader *arBundleHeader) {
+  memset(arBundleHeader, 0, sizeof(*arBundleHeader));
+}
+
+void BundleHeaderFree(struct ArweaveBundleHeader *arBundleHeader) {
+  free(arBundleHeader->sizes);
+  free(arBundleHeader->ids);
+  free(arBundleHeader->starts);
+  BundleHeaderInit(arBundleHeader);
+}
+
+/**
+ * @brief Read a 32 byte little endian integer
+ * @return 0 on success, -1 if it doesn't fit in 64 bits
+ **/
+int ReadU256(const uint8_t *field, uint64_t *value) {
+  *value = 0;
+  for (int i = 31; i >= 8; i--) {
+    if (field[i] != 0) {
+      return -1;
+    }
+  }
+  for (int i = 7; i >= 0; i--) {
+    *value = (*value << 8) | field[i];
+  }
+  return 0;
+}
+
+void BundleHeaderPrint(struct ArweaveBundle *arBundle,
+                       struct ArweaveBundleHeader *arBundleHeader) {
+  char id[44];
+
+  printf("bundle %s holds %u data items\n", arBundle->tx_id, arBundleHeader->data_item_cnt);
+  for (uint32_t i = 0; verbose && i < arBundleHeader->entry_cnt; i++) {
+    base64urlEncode(arBundleHeader->ids[i], 32, id);
+    printf("item %u id %s start %" PRIu64 " size %" PRIu64 "\n", i, id,
+           arBundleHeader->starts[i], arBundleHeader->sizes[i]);
+  }
+}
+
+/**
+ * @brief Take the item count off the front of the header
+ *
+ * The count is checked against the bundle size before anything is
+ * allocated for it, so a corrupt header can't ask for a huge table.
+ **/
+void BundleHeaderCount(struct ArweaveBundle *arBundle,
+                       struct ArweaveBundleHeader *arBundleHeader,
+                       struct StateMachine *state,
+                       const uint8_t *field) {
+  uint64_t cnt;
+
+  if (ReadU256(field, &cnt) == -1 || cnt > (arBundle->size - 32) / 64 || cnt > UINT32_MAX) {
+    fprintf(stderr, "bundle %s has a corrupt item count\n", arBundle->tx_id);
+    exit(EXIT_FAILURE);
+  }
+  arBundleHeader->data_item_cnt = cnt;
+  state->di_cnt_done = 1;
+  state->iter_index = 0;
+  printf("data_item_cnt %u\n", arBundleHeader->data_item_cnt);
+
+  if (arBundle->item_id[0] != 0 || arBundle->plan != NULL) {
+    // --item and --extract only need the header for now, don't fetch past it
+    arBundle->fetchEndOffset = arBundle->startOffset + 32 + 64 * cnt - 1;
+  }
+}
+
+/**
+ * @brief Look a data item up in the offsets table
+ * @param[in] id Base64url encoded item id
+ * @return Entry index, -1 if the bundle doesn't hold the item
+ **/
+int64_t BundleHeaderFind(struct ArweaveBundleHeader *arBundleHeader, const char *id) {
+  char raw[48];
+  int rawLen;
+
+  if (!base64urlDecode(id, strlen(id), raw, &rawLen) || rawLen != 32) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < arBundleHeader->entry_cnt; i++) {
+    if (memcmp(arBundleHeader->ids[i], raw, 32) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Write the part of a chunk that falls inside the --item to item_fd
+ * @param[in] pos Bundle relative offset of the first byte of buffer
+ **/
+void WriteItemBytes(struct ArweaveBundleHeader *arBundleHeader,
+                    struct StateMachine *state,
+                    uint64_t pos,
+                    int thisCnt,
+                    const char *buffer) {
+  uint64_t itemStart = arBundleHeader->starts[state->item_index];
+  uint64_t itemEnd = itemStart + arBundleHeader->sizes[state->item_index];
+  uint64_t from = pos > itemStart ? pos : itemStart;
+  uint64_t to = pos + thisCnt < itemEnd ? pos + thisCnt : itemEnd;
+
+  if (from >= to) {
+    return;
+  }
+  if (pwrite(state->item_fd, buffer + (from - pos), to - from, from - itemStart) !=
+      (ssize_t)(to - from)) {
+    perror("pwrite");
+    exit(1);
+  }
+  state->item_written += to - from;
+}
+
+/**
+ * @brief Create the file a data item is written to, sized up front
+ *
+ * Preallocating keeps the file in few extents however its bytes arrive.
+ **/
+int CreateItemFile(const char *path, uint64_t size) {
+  int fd;
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+    perror("open");
+    exit(1);
+  }
+  if (size > 0 && fallocate(fd, 0, 0, size) == -1) {
+    // not every filesystem preallocates, the file still gets its final size
+    if (ftruncate(fd, size) == -1) {
+      perror("ftruncate");
+      exit(1);
+    }
+  }
+  return fd;
+}
+
+/**
+ * @brief Start writing out the data item at state->item_index
+ **/
+void UnbundleOpenItem(struct ArweaveBundle *arBundle,
+                      struct ArweaveBundleHeader *arBundleHeader,
+                      struct StateMachine *state) {
+  char path[640];
+  char id[44];
+
+  base64urlEncode(arBundleHeader->ids[state->item_index], 32, id);
+  snprintf(path, sizeof(path), "%s/%s", arBundle->unbundle_dir, id);
+  state->item_fd = CreateItemFile(path, arBundleHeader->sizes[state->item_index]);
+  state->item_written = 0;
+}
+
+/**
+ * @brief Whether --filter turned entry i down
+ **/
+int ItemDropped(struct StateMachine *state, uint64_t i) {
+  return state->item_drop != NULL && (state->item_drop[i / 8] >> (i % 8)) & 1;
+}
+
+/**
+ * @brief Step past an item --filter turned down, removing what was written
+ **/
+void UnbundleDropItem(struct ArweaveBundle *arBundle,
+                      struct ArweaveBundleHeader *arBundleHeader,
+                      struct StateMachine *state) {
+  char path[640];
+  char id[44];
+
+  if (state->item_fd != -1) {
+    close(state->item_fd);
+    state->item_fd = -1;
+    base64urlEncode(arBundleHeader->ids[state->item_index], 32, id);
+    snprintf(path, sizeof(path), "%s/%s", arBundle->unbundle_dir, id);
+    unlink(path);
+  }
+  state->item_index++;
+  state->item_written = 0;
+}
+
+/**
+ * @brief Write every data item overlapping a chunk to its own file
+ *
+ * Items are laid out back to back, so walking them along with the chunks
+ * keeps only the item being written open. Each piece lands at its offset
+ * inside the item, however the chunk boundaries cut it.
+ *
+ * @param[in] pos Bundle relative offset of the first byte of buffer
+ **/
+void UnbundleChunk(struct ArweaveBundle *arBundle,
+                   struct ArweaveBundleHeader *arBundleHeader,
+                   struct StateMachine *state,
+                   uint64_t pos,
+                   int thisCnt,
+                   const char *buffer) {
+  uint64_t i;
+
+  while ((i = state->item_index) < arBundleHeader->entry_cnt) {
+    if (arBundleHeader->starts[i] >= pos + thisCnt) {
+      return;
+    }
+    // the tags come before anything of the item is written, but its
+    // header may be cut by a chunk boundary
+    if (ItemDropped(state, i)) {
+      UnbundleDropItem(arBundle, arBundleHeader, state);
+      continue;
+    }
+    if (state->item_fd == -1) {
+      UnbundleOpenItem(arBundle, arBundleHeader, state);
+    }
+    WriteItemBytes(arBundleHeader, state, pos, thisCnt, buffer);
+    if (state->item_written < arBundleHeader->sizes[i]) {
+      return;
+    }
+    close(state->item_fd);
+    state->item_fd = -1;
+    state->item_index++;
+    state->item_written = 0;
+  }
+}
+
+/**
+ * --extract, data items pulled out of one bundle in a single pass. Each
+ * item found in the header is mapped to the MAX_CHUNK_SIZE aligned chunks
+ * it spans, and overlapping or adjacent spans are merged into runs in
+ * bundle order. The fetch only asks for the chunks of the runs, so a chunk
+ * shared by many small items comes in once.
+ **/
+struct ExtractId {
+  char id[64];
+  uint8_t raw[32];
+};
+
+struct ExtractTarget {
+  uint64_t start;
+  uint64_t size;
+  uint64_t written;
+  int fd;
+  // entry in wanted
+  uint32_t want;
+};
+
+struct ExtractRun {
+  // bundle relative and MAX_CHUNK_SIZE aligned, to is one past the end
+  uint64_t from;
+  uint64_t to;
+};
+
+struct ExtractPlan {
+  // ids read from the list, sorted by raw id with duplicates dropped
+  struct ExtractId *wanted;
+  uint32_t cnt;
+  // items the header holds, in bundle order, and the first not written yet
+  struct ExtractTarget *targets;
+  uint32_t target_cnt;
+  uint32_t target_at;
+  struct ExtractRun *runs;
+  uint32_t run_cnt;
+  // set once the header is in and the runs are laid out
+  int built;
+  uint32_t missing;
+  // chunks the runs cover, and what fetching item by item would take
+  uint64_t chunks;
+  uint64_t item_chunks;
+};
+
+int ExtractIdCompare(const void *a, const void *b) {
+  return memcmp(((const struct ExtractId *)a)->raw, ((const struct ExtractId *)b)->raw, 32);
+}
+
+int ExtractIdFind(const void *key, const void *b) {
+  return memcmp(key, ((const struct ExtractId *)b)->raw, 32);
+}
+
+int ExtractTargetCompare(const void *a, const void *b) {
+  const struct ExtractTarget *x = a, *y = b;
+
+  return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/**
+ * @brief Forget the bundle the plan was laid out for
+ *
+ * Files of items a failed run left half written are closed.
+ **/
+void ExtractReset(struct ExtractPlan *plan) {
+  for (uint32_t k = 0; k < plan->target_cnt; k++) {
+    if (plan->targets[k].fd != -1) {
+      close(plan->targets[k].fd);
+    }
+  }
+  free(plan->targets);
+  free(plan->runs);
+  plan->targets = NULL;
+  plan->runs = NULL;
+  plan->target_cnt = 0;
+  plan->target_at = 0;
+  plan->run_cnt = 0;
+  plan->built = 0;
+  plan->missing = 0;
+  plan->chunks = 0;
+  plan->item_chunks = 0;
+}
+
+void ExtractFree(struct ExtractPlan *plan) {
+  ExtractReset(plan);
+  free(plan->wanted);
+  plan->wanted = NULL;
+  plan->cnt = 0;
+}
+
+/**
+ * @brief Look the --extract ids up in the offsets table and lay out the
+ *        chunk runs covering them
+ *
+ * The table is walked once, each entry looked up among the sorted ids,
+ * rather than searched once per id. Once the runs are known the fetch is
+ * let go on up to the end of the last one.
+ **/
+void ExtractPlanBuild(struct ArweaveBundle *arBundle,
+                      struct ArweaveBundleHeader *arBundleHeader) {
+  struct ExtractPlan *plan = arBundle->plan;
+  struct ExtractTarget *t;
+  struct ExtractRun *run;
+  struct ExtractId *hit;
+  uint8_t *found;
+  uint64_t from, to;
+
+  plan->targets = malloc((plan->cnt + 1) * sizeof(struct ExtractTarget));
+  plan->runs = malloc((plan->cnt + 1) * sizeof(struct ExtractRun));
+  found = calloc(plan->cnt + 1, 1);
+  if (plan->targets == NULL || plan->runs == NULL || found == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  for (uint32_t i = 0; i < arBundleHeader->entry_cnt; i++) {
+    hit = bsearch(arBundleHeader->ids[i], plan->wanted, plan->cnt, sizeof(struct ExtractId),
+                  ExtractIdFind);
+    // an id the header lists twice is written out once
+    if (hit == NULL || found[hit - plan->wanted]) {
+      continue;
+    }
+    found[hit - plan->wanted] = 1;
+    t = &plan->targets[plan->target_cnt++];
+    t->start = arBundleHeader->starts[i];
+    t->size = arBundleHeader->sizes[i];
+    t->written = 0;
+    t->fd = -1;
+    t->want = hit - plan->wanted;
+  }
+  for (uint32_t k = 0; k < plan->cnt; k++) {
+    if (!found[k]) {
+      fprintf(stderr, "bundle %s holds no item %s\n", arBundle->tx_id, plan->wanted[k].id);
+      plan->missing++;
+    }
+  }
+  free(found);
+
+  qsort(plan->targets, plan->target_cnt, sizeof(struct ExtractTarget), ExtractTargetCompare);
+  for (uint32_t k = 0; k < plan->target_cnt; k++) {
+    t = &plan->targets[k];
+    if (t->size == 0) {
+      continue;
+    }
+    from = t->start / MAX_CHUNK_SIZE * MAX_CHUNK_SIZE;
+    to = ((t->start + t->size - 1) / MAX_CHUNK_SIZE + 1) * MAX_CHUNK_SIZE;
+    plan->item_chunks += (to - from) / MAX_CHUNK_SIZE;
+    if (plan->run_cnt > 0 && from <= (run = &plan->runs[plan->run_cnt - 1])->to) {
+      if (to > run->to) {
+        run->to = to;
+      }
+      continue;
+    }
+    run = &plan->runs[plan->run_cnt++];
+    run->from = from;
+    run->to = to;
+  }
+  for (uint32_t r = 0; r < plan->run_cnt; r++) {
+    plan->chunks += (plan->runs[r].to - plan->runs[r].from) / MAX_CHUNK_SIZE;
+  }
+  plan->built = 1;
+
+  if (plan->run_cnt > 0) {
+    to = plan->runs[plan->run_cnt - 1].to;
+    arBundle->fetchEndOffset =
+      arBundle->startOffset + (to < arBundle->size ? to : arBundle->size) - 1;
+  }
+  printf("extract: %u of %u items found, %" PRIu64 " chunks in %u runs, %" PRIu64
+         " item by item\n",
+         plan->target_cnt, plan->cnt, plan->chunks, plan->run_cnt, plan->item_chunks);
+}
+
+/**
+ * @brief First weave offset at or past offset that --extract wants fetched
+ *
+ * Offsets inside a run are wanted as they are, past the last run it's the
+ * end of the bundle. Until the runs are laid out everything is wanted.
+ **/
+uint64_t FetchNextWanted(struct ArweaveBundle *arBundle, uint64_t offset) {
+  struct ExtractPlan *plan = arBundle->plan;
+  uint64_t pos = offset - arBundle->startOffset;
+  uint32_t lo = 0, hi, mid;
+
+  if (plan == NULL || !plan->built) {
+    return offset;
+  }
+  hi = plan->run_cnt;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (plan->runs[mid].to <= pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == plan->run_cnt) {
+    return arBundle->startOffset + arBundle->size;
+  }
+  return plan->runs[lo].from > pos ? arBundle->startOffset + plan->runs[lo].from : offset;
+}
+
+/**
+ * @brief Write the pieces of the --extract items a chunk holds
+ *
+ * Chunks come in bundle order and items don't overlap, so the items are
+ * finished in order and only those the chunk cuts through stay open.
+ *
+ * @param[in] pos Bundle relative offset of the first byte of buffer
+ **/
+void ExtractChunk(struct ExtractPlan *plan, uint64_t pos, int thisCnt, const char *buffer) {
+  struct ExtractTarget *t;
+  uint64_t from, to;
+
+  for (uint32_t k = plan->target_at; k < plan->target_cnt; k++) {
+    t = &plan->targets[k];
+    if (t->start >= pos + thisCnt) {
+      break;
+    }
+    from = pos > t->start ? pos : t->start;
+    to = pos + thisCnt < t->start + t->size ? pos + thisCnt : t->start + t->size;
+    if (from >= to) {
+      continue;
+    }
+    if (t->fd == -1) {
+      t->fd = CreateItemFile(plan->wanted[t->want].id, t->size);
+    }
+    if (pwrite(t->fd, buffer + (from - pos), to - from, from - t->start) != (ssize_t)(to - from)) {
+      perror("pwrite");
+      exit(1);
+    }
+    t->written += to - from;
+    if (t->written == t->size) {
+      close(t->fd);
+      t->fd = -1;
+    }
+  }
+  while (plan->target_at < plan->target_cnt &&
+         plan->targets[plan->target_at].written == plan->targets[plan->target_at].size) {
+    plan->target_at++;
+  }
+}
+
+/**
+ * @brief Append one (size, id) entry to the offsets table
+ **/
+void BundleHeaderEntry(struct ArweaveBundle *arBundle,
+                       struct ArweaveBundleHeader *arBundleHeader,
+                       struct StateMachine *state,
+                       const uint8_t *field) {
+  uint32_t i = arBundleHeader->entry_cnt;
+  uint32_t cap;
+
+  if (i == arBundleHeader->entry_cap) {
+    // grow geometrically, but never past the count the header announced
+    cap = arBundleHeader->entry_cap ? arBundleHeader->entry_cap * 2 : 1024;
+    if (cap > arBundleHeader->data_item_cnt) {
+      cap = arBundleHeader->data_item_cnt;
+    }
+    arBundleHeader->sizes = realloc(arBundleHeader->sizes, cap * sizeof(uint64_t));
+    arBundleHeader->ids = realloc(arBundleHeader->ids, cap * sizeof(arBundleHeader->ids[0]));
+    arBundleHeader->starts = realloc(arBundleHeader->starts, cap * sizeof(uint64_t));
+    if (arBundleHeader->sizes == NULL || arBundleHeader->ids == NULL ||
+        arBundleHeader->starts == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+    arBundleHeader->entry_cap = cap;
+  }
+
+  if (ReadU256(field, &arBundleHeader->sizes[i]) == -1) {
+    fprintf(stderr, "bundle %s has a corrupt size for item %u\n", arBundle->tx_id, i);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(arBundleHeader->ids[i], field + 32, 32);
+  arBundleHeader->starts[i] = i == 0 ?
+    32 + 64 * (uint64_t)arBundleHeader->data_item_cnt :
+    arBundleHeader->starts[i - 1] + arBundleHeader->sizes[i - 1];
+
+  if (arBundleHeader->sizes[i] > arBundle->size ||
+      arBundleHeader->starts[i] + arBundleHeader->sizes[i] > arBundle->size) {
+    fprintf(stderr, "item %u runs past the end of bundle %s\n", i, arBundle->tx_id);
+    exit(EXIT_FAILURE);
+  }
+  arBundleHeader->entry_cnt++;
+  state->iter_index++;
+}
+
+/**
+ * ANS-104 signature types, indexed by the type field at the front of a
+ * data item, with the lengths of the signature and owner following it.
+ **/
+struct DataItemSignatureType {
+  const char *name;
+  int signature_len;
+  int owner_len;
+};
+
+static const struct DataItemSignatureType dataItemSignatureTypes[] = {
+  {NULL, 0, 0},
+  {"arweave", 512, 512},
+  {"ed25519", 64, 32},
+  {"ethereum", 65, 65},
+  {"solana", 64, 32},
+  {"injectedaptos", 64, 32},
+  {"multiaptos", 64 * 32 + 4, 32 * 32 + 1},
+  {"typedethereum", 65, 42},
+};
+
+#define DATA_ITEM_SIGNATURE_TYPES \
+  (int)(sizeof(dataItemSignatureTypes) / sizeof(dataItemSignatureTypes[0]))
+// longest owner of any signature type
+#define DATA_ITEM_MAX_OWNER (32 * 32 + 1)
+
+// What a data item parser hands out, in the order it comes in an item
+enum DataItemField {
+  ITEM_SIGNATURE,
+  ITEM_OWNER,
+  ITEM_TARGET,
+  ITEM_ANCHOR,
+  ITEM_TAG_NAME,
+  ITEM_TAG_VALUE,
+  // no bytes, the tag block is done and data_start is known
+  ITEM_HEADER_END,
+  ITEM_DATA,
+  // no bytes, the item doesn't parse or was cut short, error says why
+  ITEM_INVALID,
+  ITEM_FIELDS
+};
+
+enum DataItemState {
+  ITEM_STATE_SIGNATURE_TYPE,
+  ITEM_STATE_SIGNATURE,
+  ITEM_STATE_OWNER,
+  ITEM_STATE_TARGET_FLAG,
+  ITEM_STATE_TARGET,
+  ITEM_STATE_ANCHOR_FLAG,
+  ITEM_STATE_ANCHOR,
+  ITEM_STATE_TAG_CNT,
+  ITEM_STATE_TAG_BYTES,
+  // Avro array of {name: bytes, value: bytes} records, zigzag varint counts
+  ITEM_STATE_BLOCK_CNT,
+  ITEM_STATE_BLOCK_SIZE,
+  ITEM_STATE_NAME_LEN,
+  ITEM_STATE_NAME,
+  ITEM_STATE_VALUE_LEN,
+  ITEM_STATE_VALUE,
+  ITEM_STATE_DATA,
+  // past a bad or unwanted header, waiting for the next item
+  ITEM_STATE_SKIP
+};
+
+struct DataItemParser;
+
+/**
+ * Gets each piece of a field. A field cut by a chunk boundary comes in
+ * several calls, last is set on the final one. data points into the chunk
+ * being fed and is only good for the duration of the call; it may be NULL
+ * when len is 0. Returning non zero skips the rest of the item.
+ **/
+typedef int (*DataItemSpan)(void *ctx, struct DataItemParser *dp, int field,
+                            const uint8_t *data, int len, int last);
+
+/**
+ * Walks the data items of a bundle as its chunks come in, once the offsets
+ * table is parsed. Nothing is copied or allocated: fields are handed out as
+ * spans of the chunk buffers, only integers cut by a chunk boundary are
+ * carried over in value.
+ **/
+struct DataItemParser {
+  const struct ArweaveBundleHeader *header;
+  // entry of the item being parsed, entry_cnt once past the last one
+  uint32_t item;
+  // bundle relative offset of the next byte the parser expects
+  uint64_t pos;
+  // bytes of the item past pos
+  uint64_t item_left;
+  int state;
+  // bytes left of the fixed size or length prefixed field being parsed
+  uint64_t field_left;
+  // integer or varint being assembled, and the bit its next byte goes to
+  uint64_t value;
+  int shift;
+  uint16_t signature_type;
+  uint64_t tag_cnt;
+  uint64_t tag_bytes;
+  // bytes of the tag block left, tags decoded, tags left in the Avro block
+  uint64_t tag_left;
+  uint64_t tags_seen;
+  uint64_t block_left;
+  // bundle relative offset of the item's data
+  uint64_t data_start;
+  // set by a span turning the item down before the spans after it see
+  // ITEM_HEADER_END, its data is never asked for
+  int dropped;
+  const char *error;
+  // headers parsed and items that didn't parse, over all bundles
+  uint64_t items;
+  uint64_t invalid;
+  DataItemSpan span;
+  void *ctx;
+};
+
+void DataItemParserInit(struct DataItemParser *dp, DataItemSpan span, void *ctx) {
+  memset(dp, 0, sizeof(*dp));
+  dp->span = span;
+  dp->ctx = ctx;
+}
+
+/**
+ * @brief Hand a span to the consumer, which may ask to skip the item
+ **/
+void DataItemEmit(struct DataItemParser *dp, int field, const uint8_t *data, int len, int last) {
+  if (dp->span(dp->ctx, dp, field, data, len, last) != 0) {
+    dp->state = ITEM_STATE_SKIP;
+  }
+}
+
+void DataItemInvalid(struct DataItemParser *dp, const char *error) {
+  dp->error = error;
+  dp->invalid++;
+  dp->state = ITEM_STATE_SKIP;
+  dp->span(dp->ctx, dp, ITEM_INVALID, NULL, 0, 1);
+}
+
+void DataItemExpect(struct DataItemParser *dp, int state, uint64_t len) {
+  dp->state = state;
+  dp->field_left = len;
+  dp->value = 0;
+  dp->shift = 0;
+}
+
+/**
+ * @brief Get ready for the item at dp->item
+ **/
+void DataItemBegin(struct DataItemParser *dp) {
+  const struct ArweaveBundleHeader *h = dp->header;
+
+  if (dp->item >= h->entry_cnt) {
+    return;
+  }
+  dp->pos = h->starts[dp->item];
+  dp->item_left = h->sizes[dp->item];
+  dp->signature_type = 0;
+  dp->tag_cnt = 0;
+  dp->tag_bytes = 0;
+  dp->tags_seen = 0;
+  dp->data_start = 0;
+  dp->dropped = 0;
+  dp->error = NULL;
+  DataItemExpect(dp, ITEM_STATE_SIGNATURE_TYPE, 2);
+}
+
+/**
+ * @brief Start on the first item of a bundle whose offsets table is parsed
+ **/
+void DataItemParserStart(struct DataItemParser *dp, const struct ArweaveBundleHeader *header) {
+  dp->header = header;
+  dp->item = 0;
+  DataItemBegin(dp);
+}
+
+void DataItemNext(struct DataItemParser *dp) {
+  if (dp->state != ITEM_STATE_DATA && dp->state != ITEM_STATE_SKIP) {
+    DataItemInvalid(dp, "item ends inside its header");
+  }
+  dp->item++;
+  DataItemBegin(dp);
+}
+
+void DataItemHeaderEnd(struct DataItemParser *dp) {
+  dp->data_start = dp->pos;
+  dp->items++;
+  dp->state = ITEM_STATE_DATA;
+  DataItemEmit(dp, ITEM_HEADER_END, NULL, 0, 1);
+  if (dp->state == ITEM_STATE_DATA && dp->item_left == 0) {
+    DataItemEmit(dp, ITEM_DATA, NULL, 0, 1);
+  }
+}
+
+/**
+ * @brief Act on a little endian integer or flag once all its bytes are in
+ **/
+void DataItemIntegerDone(struct DataItemParser *dp) {
+  const struct DataItemSignatureType *type;
+
+  switch (dp->state) {
+  case ITEM_STATE_SIGNATURE_TYPE:
+    if (dp->value == 0 || dp->value >= DATA_ITEM_SIGNATURE_TYPES) {
+      DataItemInvalid(dp, "unknown signature type");
+      return;
+    }
+    dp->signature_type = dp->value;
+    type = &dataItemSignatureTypes[dp->signature_type];
+    DataItemExpect(dp, ITEM_STATE_SIGNATURE, type->signature_len);
+    break;
+
+  case ITEM_STATE_TARGET_FLAG:
+  case ITEM_STATE_ANCHOR_FLAG:
+    if (dp->value > 1) {
+      DataItemInvalid(dp, "presence byte isn't 0 or 1");
+    } else if (dp->value == 1) {
+      DataItemExpect(dp, dp->state + 1, 32);
+    } else if (dp->state == ITEM_STATE_TARGET_FLAG) {
+      DataItemExpect(dp, ITEM_STATE_ANCHOR_FLAG, 1);
+    } else {
+      DataItemExpect(dp, ITEM_STATE_TAG_CNT, 8);
+    }
+    break;
+
+  case ITEM_STATE_TAG_CNT:
+    dp->tag_cnt = dp->value;
+    DataItemExpect(dp, ITEM_STATE_TAG_BYTES, 8);
+    break;
+
+  case ITEM_STATE_TAG_BYTES:
+    dp->tag_bytes = dp->value;
+    if (dp->tag_bytes > dp->item_left) {
+      DataItemInvalid(dp, "tag block runs past the item");
+    } else if (dp->tag_bytes == 0 && dp->tag_cnt != 0) {
+      DataItemInvalid(dp, "tags counted but no tag bytes");
+    } else if (dp->tag_bytes == 0) {
+      DataItemHeaderEnd(dp);
+    } else {
+      dp->tag_left = dp->tag_bytes;
+      DataItemExpect(dp, ITEM_STATE_BLOCK_CNT, 0);
+    }
+    break;
+  }
+}
+
+/**
+ * @brief Act on a zigzag decoded Avro long of the tag block
+ **/
+void DataItemVarintDone(struct DataItemParser *dp, int64_t n) {
+  uint64_t cnt = n < 0 ? -(uint64_t)n : (uint64_t)n;
+
+  switch (dp->state) {
+  case ITEM_STATE_BLOCK_CNT:
+    if (n == 0) {
+      if (dp->tag_left != 0) {
+        DataItemInvalid(dp, "tag block has bytes past its end");
+      } else if (dp->tags_seen != dp->tag_cnt) {
+        DataItemInvalid(dp, "tag count doesn't match the tag block");
+      } else {
+        DataItemHeaderEnd(dp);
+      }
+    } else if (cnt > dp->tag_cnt - dp->tags_seen) {
+      DataItemInvalid(dp, "tag block holds more tags than counted");
+    } else {
+      // a negative count is followed by the byte size of the block
+      dp->block_left = cnt;
+      DataItemExpect(dp, n < 0 ? ITEM_STATE_BLOCK_SIZE : ITEM_STATE_NAME_LEN, 0);
+    }
+    break;
+
+  case ITEM_STATE_BLOCK_SIZE:
+    DataItemExpect(dp, ITEM_STATE_NAME_LEN, 0);
+    break;
+
+  case ITEM_STATE_NAME_LEN:
+  case ITEM_STATE_VALUE_LEN:
+    if (n < 0 || cnt > dp->tag_left) {
+      DataItemInvalid(dp, "tag runs past the tag block");
+      return;
+    }
+    DataItemExpect(dp, dp->state + 1, cnt);
+    break;
+  }
+}
+
+/**
+ * @brief Parse what the current state wants out of the next n bytes
+ * @param[in] n Bytes available, no more than are left of the item
+ **/
+void DataItemStep(struct DataItemParser *dp, const uint8_t *p, uint64_t n) {
+  uint64_t take = n < dp->field_left ? n : dp->field_left;
+  int state = dp->state;
+  int field, done;
+
+  switch (state) {
+  case ITEM_STATE_SIGNATURE_TYPE:
+  case ITEM_STATE_TARGET_FLAG:
+  case ITEM_STATE_ANCHOR_FLAG:
+  case ITEM_STATE_TAG_CNT:
+  case ITEM_STATE_TAG_BYTES:
+    for (uint64_t i = 0; i < take; i++) {
+      dp->value |= (uint64_t)p[i] << dp->shift;
+      dp->shift += 8;
+    }
+    dp->field_left -= take;
+    dp->pos += take;
+    dp->item_left -= take;
+    if (dp->field_left == 0) {
+      DataItemIntegerDone(dp);
+    }
+    break;
+
+  case ITEM_STATE_SIGNATURE:
+  case ITEM_STATE_OWNER:
+  case ITEM_STATE_TARGET:
+  case ITEM_STATE_ANCHOR:
+    dp->field_left -= take;
+    dp->pos += take;
+    dp->item_left -= take;
+    if ((done = dp->field_left == 0)) {
+      if (state == ITEM_STATE_SIGNATURE) {
+        DataItemExpect(dp, ITEM_STATE_OWNER,
+                       dataItemSignatureTypes[dp->signature_type].owner_len);
+      } else if (state == ITEM_STATE_OWNER || state == ITEM_STATE_TARGET) {
+        DataItemExpect(dp, ITEM_STATE_TARGET_FLAG + 2 * (state != ITEM_STATE_OWNER), 1);
+      } else {
+        DataItemExpect(dp, ITEM_STATE_TAG_CNT, 8);
+      }
+    }
+    field = state == ITEM_STATE_SIGNATURE ? ITEM_SIGNATURE :
+            state == ITEM_STATE_OWNER ? ITEM_OWNER :
+            state == ITEM_STATE_TARGET ? ITEM_TARGET : ITEM_ANCHOR;
+    DataItemEmit(dp, field, p, take, done);
+    break;
+
+  case ITEM_STATE_BLOCK_CNT:
+  case ITEM_STATE_BLOCK_SIZE:
+  case ITEM_STATE_NAME_LEN:
+  case ITEM_STATE_VALUE_LEN:
+    if (dp->tag_left == 0) {
+      DataItemInvalid(dp, "tag block ends inside a length");
+      return;
+    }
+    dp->tag_left--;
+    dp->pos++;
+    dp->item_left--;
+    dp->value |= (uint64_t)(p[0] & 0x7f) << dp->shift;
+    if (p[0] & 0x80) {
+      if ((dp->shift += 7) > 63) {
+        DataItemInvalid(dp, "tag length doesn't fit in 64 bits");
+      }
+      return;
+    }
+    DataItemVarintDone(dp, (int64_t)(dp->value >> 1) ^ -(int64_t)(dp->value & 1));
+    if ((dp->state == ITEM_STATE_NAME || dp->state == ITEM_STATE_VALUE) && dp->field_left == 0) {
+      // an empty name or value still gets its span
+      DataItemStep(dp, NULL, 0);
+    }
+    break;
+
+  case ITEM_STATE_NAME:
+  case ITEM_STATE_VALUE:
+    dp->field_left -= take;
+    dp->tag_left -= take;
+    dp->pos += take;
+    dp->item_left -= take;
+    if ((done = dp->field_left == 0) && state == ITEM_STATE_NAME) {
+      DataItemExpect(dp, ITEM_STATE_VALUE_LEN, 0);
+    } else if (done) {
+      dp->tags_seen++;
+      DataItemExpect(dp, --dp->block_left > 0 ? ITEM_STATE_NAME_LEN : ITEM_STATE_BLOCK_CNT, 0);
+    }
+    DataItemEmit(dp, state == ITEM_STATE_NAME ? ITEM_TAG_NAME : ITEM_TAG_VALUE, p, take, done);
+    break;
+
+  case ITEM_STATE_DATA:
+    dp->pos += n;
+    dp->item_left -= n;
+    DataItemEmit(dp, ITEM_DATA, p, n, dp->item_left == 0);
+    break;
+
+  case ITEM_STATE_SKIP:
+    dp->pos += n;
+    dp->item_left -= n;
+    break;
+  }
+}
+
+/**
+ * @brief Pick the walk up at pos after a run of bytes that was never fed
+ *
+ * That happens on --resume and when an --item only fetches its own chunks.
+ * An item the gap cuts into is given up on, and one the gap starts inside
+ * of is skipped.
+ **/
+void DataItemParserSeek(struct DataItemParser *dp, uint64_t pos) {
+  const struct ArweaveBundleHeader *h = dp->header;
+
+  if (dp->item < h->entry_cnt && dp->pos > h->starts[dp->item] &&
+      dp->state != ITEM_STATE_SKIP) {
+    DataItemInvalid(dp, "chunks of the item were never fetched");
+  }
+  while (dp->item < h->entry_cnt && h->starts[dp->item] + h->sizes[dp->item] <= pos) {
+    dp->item++;
+  }
+  DataItemBegin(dp);
+  if (dp->item < h->entry_cnt && dp->pos < pos) {
+    dp->state = ITEM_STATE_SKIP;
+    dp->item_left -= pos - dp->pos;
+    dp->pos = pos;
+  }
+}
+
+/**
+ * @brief Parse the data items overlapping the next bytes of the bundle
+ * @param[in] pos Bundle relative offset of the first byte of buffer
+ **/
+void DataItemParserFeed(struct DataItemParser *dp, uint64_t pos, const uint8_t *buffer,
+                        uint64_t len) {
+  const struct ArweaveBundleHeader *h = dp->header;
+  uint64_t end = pos + len;
+  uint64_t n;
+
+  if (pos > dp->pos) {
+    DataItemParserSeek(dp, pos);
+  }
+  // bytes before dp->pos were fed already, by the header pass of an --item
+  while (dp->item < h->entry_cnt) {
+    if (dp->item_left == 0) {
+      DataItemNext(dp);
+      continue;
+    }
+    if (dp->pos >= end) {
+      break;
+    }
+    n = end - dp->pos < dp->item_left ? end - dp->pos : dp->item_left;
+    DataItemStep(dp, buffer + (dp->pos - pos), n);
+  }
+}
+
+/**
+ * @brief Give up on an item the bundle's chunks stopped inside of
+ **/
+void DataItemParserFinish(struct DataItemParser *dp) {
+  const struct ArweaveBundleHeader *h = dp->header;
+
+  if (h != NULL && dp->item < h->entry_cnt && dp->pos > h->starts[dp->item] &&
+      dp->state != ITEM_STATE_SKIP) {
+    DataItemInvalid(dp, "chunks of the item were never fetched");
+  }
+  dp->header = NULL;
+}
+
+/**
+ * Writes one JSON line per data item for --items: its id, signature type,
+ * owner, target and anchor in base64url, tags and where its data lies.
+ **/
+struct ItemJsonWriter {
+  FILE *out;
+  // id of the item a --recursive nested bundle is the data of, else NULL
+  const char *parent;
+  int depth;
+  // owner, target or anchor, gathered across chunk boundaries
+  uint8_t field[DATA_ITEM_MAX_OWNER];
+  int field_len;
+  // a line is being written, and it's inside a tag
+  int open;
+  int in_tag;
+  int tags_open;
+};
+
+/**
+ * @brief Write bytes as the inside of a JSON string
+ *
+ * Tags are arbitrary bytes; quotes, backslashes and control characters are
+ * escaped and everything else, UTF-8 included, goes out as is.
+ **/
+void JsonWriteEscaped(FILE *out, const uint8_t *data, int len) {
+  int run = 0;
+
+  for (int i = 0; i < len; i++) {
+    if (data[i] >= 0x20 && data[i] != '"' && data[i] != '\\') {
+      continue;
+    }
+    fwrite(data + run, 1, i - run, out);
+    if (data[i] == '"' || data[i] == '\\') {
+      fprintf(out, "\\%c", data[i]);
+    } else {
+      fprintf(out, "\\u%04x", data[i]);
+    }
+    run = i + 1;
+  }
+  fwrite(data + run, 1, len - run, out);
+}
+
+/**
+ * @brief Start the line of an item
+ *
+ * The output stays locked until the line is done, so --recursive workers
+ * don't write theirs into the middle of it.
+ **/
+void ItemJsonOpen(struct ItemJsonWriter *w, struct DataItemParser *dp) {
+  char id[44];
+
+  flockfile(w->out);
+  base64urlEncode(dp->header->ids[dp->item], 32, id);
+  fprintf(w->out, "{\"item\":%u,\"id\":\"%s\"", dp->item, id);
+  if (w->parent != NULL) {
+    fprintf(w->out, ",\"parent\":\"%s\",\"depth\":%d", w->parent, w->depth);
+  }
+  w->open = 1;
+  w->in_tag = 0;
+  w->tags_open = 0;
+  w->field_len = 0;
+}
+
+int ItemJsonSpan(void *ctx, struct DataItemParser *dp, int field, const uint8_t *data, int len,
+                 int last) {
+  static const char *names[] = {"signature", "owner", "target", "anchor"};
+  struct ItemJsonWriter *w = ctx;
+  char encoded[(DATA_ITEM_MAX_OWNER * 4 + 2) / 3 + 1];
+
+  switch (field) {
+  case ITEM_SIGNATURE:
+    if (!w->open) {
+      ItemJsonOpen(w, dp);
+      fprintf(w->out, ",\"signature_type\":\"%s\"",
+              dataItemSignatureTypes[dp->signature_type].name);
+    }
+    break;
+
+  case ITEM_OWNER:
+  case ITEM_TARGET:
+  case ITEM_ANCHOR:
+    memcpy(w->field + w->field_len, data, len);
+    w->field_len += len;
+    if (last) {
+      encoded[base64urlEncode(w->field, w->field_len, encoded)] = 0;
+      fprintf(w->out, ",\"%s\":\"%s\"", names[field], encoded);
+      w->field_len = 0;
+    }
+    break;
+
+  case ITEM_TAG_NAME:
+    if (!w->in_tag) {
+      fputs(w->tags_open ? ",{\"name\":\"" : ",\"tags\":[{\"name\":\"", w->out);
+      w->tags_open = 1;
+      w->in_tag = 1;
+    }
+    JsonWriteEscaped(w->out, data, len);
+    if (last) {
+      fputs("\",\"value\":\"", w->out);
+    }
+    break;
+
+  case ITEM_TAG_VALUE:
+    JsonWriteEscaped(w->out, data, len);
+    if (last) {
+      fputs("\"}", w->out);
+      w->in_tag = 0;
+    }
+    break;
+
+  case ITEM_HEADER_END:
+    fprintf(w->out, "%s,\"data_start\":%" PRIu64 ",\"data_size\":%" PRIu64 "}\n",
+            w->tags_open ? "]" : "", dp->data_start, dp->item_left);
+    w->open = 0;
+    funlockfile(w->out);
+    // nothing past the header goes in the line
+    return 1;
+
+  case ITEM_INVALID:
+    if (!w->open) {
+      ItemJsonOpen(w, dp);
+    }
+    fprintf(w->out, "%s%s,\"error\":\"%s\"}\n", w->in_tag ? "\"}" : "",
+            w->tags_open ? "]" : "", dp->error);
+    w->open = 0;
+    funlockfile(w->out);
+    break;
+  }
+  return 0;
+}
+
+/**
+ * Bytes a nested bundle lies in. Gathered ones are freed once the last
+ * bundle inside them is dissected; data is NULL for bytes that outlive
+ * the pool, like the mapping of a --file.
+ **/
+struct NestedBuffer {
+  char *data;
+  int refs;
+};
+
+struct NestedJob {
+  struct NestedJob *next;
+  struct NestedBuffer *buf;
+  const char *data;
+  uint64_t len;
+  // 1 for a bundle in an item of the bundle fetched, and so on
+  int depth;
+  char parent[44];
+};
+
+/**
+ * --recursive: data items tagged Bundle-Format binary and Bundle-Version
+ * 2.0.0 are bundles themselves. Each one is dissected on a pool of threads
+ * once its bytes are in, and the bundles nested in it are queued in turn,
+ * so siblings are dissected side by side.
+ **/
+struct NestedPool {
+  pthread_mutex_t lock;
+  // a job was queued, or the workers are to stop
+  pthread_cond_t work;
+  // pending dropped to 0
+  pthread_cond_t done;
+  struct NestedJob *head;
+  struct NestedJob *tail;
+  // jobs queued or being dissected
+  int pending;
+  int stopping;
+  pthread_t workers[NESTED_MAX_WORKERS];
+  int worker_cnt;
+  int max_depth;
+  // --unbundle directory nested items are written to as well, else NULL
+  char *unbundle_dir;
+  // --items output, NULL without it
+  FILE *items_out;
+  uint64_t bundles;
+  uint64_t items;
+  uint64_t invalid;
+  // nested bundles not dissected, past max_depth or not a bundle after all
+  uint64_t too_deep;
+  uint64_t broken;
+};
+
+/**
+ * Sits between a data item parser and its --items writer, if any, and
+ * looks for the bundle tags in each item's header. The data of a tagged
+ * item is gathered as it streams past, unless the bundle it's in is in
+ * memory already.
+ **/
+struct NestedScanner {
+  struct NestedPool *pool;
+  DataItemSpan next;
+  void *next_ctx;
+  // of the bundle parsed, 0 for the one fetched
+  int depth;
+  // the whole of the bundle parsed when it's in memory, else NULL
+  const char *base;
+  struct NestedBuffer *base_buf;
+  // tag being read, a length of -1 when it's too long to be a bundle tag
+  char name[16];
+  int name_len;
+  char value[16];
+  int value_len;
+  int format;
+  int version;
+  struct NestedBuffer *gather;
+  uint64_t gathered;
+  uint64_t gather_len;
+  char gather_id[44];
+};
+
+void NestedBufferRelease(struct NestedPool *pool, struct NestedBuffer *buf) {
+  int refs;
+
+  if (buf == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  refs = --buf->refs;
+  pthread_mutex_unlock(&pool->lock);
+  if (refs == 0) {
+    free(buf->data);
+    free(buf);
+  }
+}
+
+/**
+ * @brief Queue a nested bundle, holding a reference to the bytes it's in
+ **/
+void NestedSubmit(struct NestedPool *pool, struct NestedBuffer *buf, const char *data,
+                  uint64_t len, int depth, const char *parent) {
+  struct NestedJob *job;
+
+  if ((job = malloc(sizeof(*job))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  job->next = NULL;
+  job->buf = buf;
+  job->data = data;
+  job->len = len;
+  job->depth = depth;
+  strcpy(job->parent, parent);
+
+  pthread_mutex_lock(&pool->lock);
+  if (buf != NULL) {
+    buf->refs++;
+  }
+  if (pool->tail != NULL) {
+    pool->tail->next = job;
+  } else {
+    pool->head = job;
+  }
+  pool->tail = job;
+  pool->pending++;
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void NestedScannerInit(struct NestedScanner *sc, struct NestedPool *pool, int depth,
+                       DataItemSpan next, void *nextCtx) {
+  memset(sc, 0, sizeof(*sc));
+  sc->pool = pool;
+  sc->depth = depth;
+  sc->next = next;
+  sc->next_ctx = nextCtx;
+}
+
+/**
+ * @brief Drop the data of an item that was being gathered
+ **/
+void NestedScannerReset(struct NestedScanner *sc) {
+  NestedBufferRelease(sc->pool, sc->gather);
+  sc->gather = NULL;
+}
+
+/**
+ * @brief Append a piece of a tag name or value, too long ones are no match
+ **/
+void NestedTagPiece(char *buf, int *len, const uint8_t *data, int n, int cap) {
+  if (*len == -1 || *len + n > cap) {
+    *len = -1;
+    return;
+  }
+  memcpy(buf + *len, data, n);
+  *len += n;
+}
+
+/**
+ * @brief Spot the nested bundles among the items the parser walks
+ *
+ * Everything is passed on to the next consumer. An item is a nested bundle
+ * when its tags hold both bundle tags, then its data is asked for even
+ * when the next consumer is done with the item.
+ **/
+int NestedSpan(void *ctx, struct DataItemParser *dp, int field, const uint8_t *data, int len,
+               int last) {
+  struct NestedScanner *sc = ctx;
+  int skip = sc->next != NULL ? sc->next(sc->next_ctx, dp, field, data, len, last) : 0;
+
+  switch (field) {
+  case ITEM_SIGNATURE:
+    sc->format = 0;
+    sc->version = 0;
+    sc->name_len = 0;
+    sc->value_len = 0;
+    break;
+
+  case ITEM_TAG_NAME:
+    NestedTagPiece(sc->name, &sc->name_len, data, len, sizeof(sc->name));
+    break;
+
+  case ITEM_TAG_VALUE:
+    NestedTagPiece(sc->value, &sc->value_len, data, len, sizeof(sc->value));
+    if (!last) {
+      break;
+    }
+    if (sc->name_len == 13 && memcmp(sc->name, "Bundle-Format", 13) == 0) {
+      sc->format = sc->value_len == 6 && memcmp(sc->value, "binary", 6) == 0;
+    } else if (sc->name_len == 14 && memcmp(sc->name, "Bundle-Version", 14) == 0) {
+      sc->version = sc->value_len == 5 && memcmp(sc->value, "2.0.0", 5) == 0;
+    }
+    sc->name_len = 0;
+    sc->value_len = 0;
+    break;
+
+  case ITEM_HEADER_END:
+    if (!sc->format || !sc->version || dp->dropped) {
+      return sc->next != NULL ? skip : 1;
+    }
+    base64urlEncode(dp->header->ids[dp->item], 32, sc->gather_id);
+    if (sc->depth + 1 > sc->pool->max_depth) {
+      __atomic_add_fetch(&sc->pool->too_deep, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+    if (sc->base != NULL) {
+      // the bytes are at hand, no need to wait for them to stream past
+      NestedSubmit(sc->pool, sc->base_buf, sc->base + dp->data_start, dp->item_left,
+                   sc->depth + 1, sc->gather_id);
+      return 1;
+    }
+    sc->gather = malloc(sizeof(*sc->gather));
+    if (sc->gather == NULL || (sc->gather->data = malloc(dp->item_left + 1)) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    sc->gather->refs = 1;
+    sc->gathered = 0;
+    sc->gather_len = dp->item_left;
+    return 0;
+
+  case ITEM_DATA:
+    if (sc->gather == NULL) {
+      return 1;
+    }
+    memcpy(sc->gather->data + sc->gathered, data, len);
+    sc->gathered += len;
+    if (last) {
+      NestedSubmit(sc->pool, sc->gather, sc->gather->data, sc->gather_len, sc->depth + 1,
+                   sc->gather_id);
+      NestedScannerReset(sc);
+    }
+    break;
+
+  case ITEM_INVALID:
+    NestedScannerReset(sc);
+    break;
+  }
+  return skip;
+}
+
+/**
+ * @brief Parse the offsets table of a bundle that's all in memory
+ *
+ * Unlike the bundle fetched, a nested one that doesn't parse only costs
+ * its own items.
+ *
+ * @return 0 on success, -1 when it isn't a bundle
+ **/
+int NestedHeader(const char *data, uint64_t len, struct ArweaveBundleHeader *header) {
+  uint64_t cnt, start;
+
+  if (len < 32 || ReadU256((const uint8_t *)data, &cnt) == -1 || cnt > (len - 32) / 64) {
+    return -1;
+  }
+  header->data_item_cnt = header->entry_cnt = header->entry_cap = cnt;
+  header->sizes = malloc(cnt * sizeof(uint64_t) + 1);
+  header->ids = malloc(cnt * sizeof(header->ids[0]) + 1);
+  header->starts = malloc(cnt * sizeof(uint64_t) + 1);
+  if (header->sizes == NULL || header->ids == NULL || header->starts == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  start = 32 + 64 * cnt;
+  for (uint64_t i = 0; i < cnt; i++) {
+    if (ReadU256((const uint8_t *)data + 32 + 64 * i, &header->sizes[i]) == -1 ||
+        header->sizes[i] > len - start) {
+      return -1;
+    }
+    memcpy(header->ids[i], data + 32 + 64 * i + 32, 32);
+    header->starts[i] = start;
+    start += header->sizes[i];
+  }
+  return 0;
+}
+
+/**
+ * @brief Write the items of a nested bundle out to the --unbundle directory
+ **/
+void NestedUnbundle(struct NestedPool *pool, struct ArweaveBundleHeader *header,
+                    const char *data) {
+  char path[640];
+  char id[44];
+  uint64_t done;
+  ssize_t n;
+  int fd;
+
+  for (uint32_t i = 0; i < header->entry_cnt; i++) {
+    base64urlEncode(header->ids[i], 32, id);
+    snprintf(path, sizeof(path), "%s/%s", pool->unbundle_dir, id);
+    fd = CreateItemFile(path, header->sizes[i]);
+    for (done = 0; done < header->sizes[i]; done += n) {
+      if ((n = pwrite(fd, data + header->starts[i] + done, header->sizes[i] - done, done)) <= 0) {
+        perror("pwrite");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+}
+
+/**
+ * @brief Dissect one nested bundle, queueing those nested in it
+ *
+ * Its --items lines are written to memory and go out in one piece, so the
+ * lines of bundles dissected side by side don't mix.
+ **/
+void NestedDissect(struct NestedPool *pool, struct NestedJob *job) {
+  struct ArweaveBundleHeader header;
+  struct DataItemParser dp;
+  struct NestedScanner sc;
+  struct ItemJsonWriter w;
+  char *lines = NULL;
+  size_t linesLen = 0;
+
+  BundleHeaderInit(&header);
+  if (NestedHeader(job->data, job->len, &header) == -1) {
+    fprintf(stderr, "item %s is tagged as a bundle but doesn't parse as one\n", job->parent);
+    BundleHeaderFree(&header);
+    __atomic_add_fetch(&pool->broken, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  printf("nested bundle %s at depth %d holds %u data items\n", job->parent, job->depth,
+         header.entry_cnt);
+
+  memset(&w, 0, sizeof(w));
+  if (pool->items_out != NULL && (w.out = open_memstream(&lines, &linesLen)) == NULL) {
+    perror("open_memstream");
+    exit(1);
+  }
+  w.parent = job->parent;
+  w.depth = job->depth;
+  NestedScannerInit(&sc, pool, job->depth, w.out != NULL ? ItemJsonSpan : NULL, &w);
+  sc.base = job->data;
+  sc.base_buf = job->buf;
+  DataItemParserInit(&dp, NestedSpan, &sc);
+  DataItemParserStart(&dp, &header);
+  DataItemParserFeed(&dp, 0, (const uint8_t *)job->data, job->len);
+  DataItemParserFinish(&dp);
+
+  if (pool->unbundle_dir != NULL) {
+    NestedUnbundle(pool, &header, job->data);
+  }
+  if (w.out != NULL) {
+    fclose(w.out);
+    flockfile(pool->items_out);
+    fwrite(lines, 1, linesLen, pool->items_out);
+    funlockfile(pool->items_out);
+    free(lines);
+  }
+  __atomic_add_fetch(&pool->bundles, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&pool->items, dp.items, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&pool->invalid, dp.invalid, __ATOMIC_RELAXED);
+  BundleHeaderFree(&header);
+}
+
+void *NestedWorker(void *arg) {
+  struct NestedPool *pool = arg;
+  struct NestedJob *job;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->head == NULL && !pool->stopping) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if ((job = pool->head) == NULL) {
+      break;
+    }
+    if ((pool->head = job->next) == NULL) {
+      pool->tail = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    NestedDissect(pool, job);
+    NestedBufferRelease(pool, job->buf);
+    free(job);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+      pthread_cond_broadcast(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * @brief Start a worker per CPU, NESTED_MAX_WORKERS at most
+ **/
+void NestedPoolInit(struct NestedPool *pool, int maxDepth, char *unbundleDir, FILE *itemsOut) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  memset(pool, 0, sizeof(*pool));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->max_depth = maxDepth;
+  pool->unbundle_dir = unbundleDir;
+  pool->items_out = itemsOut;
+  pool->worker_cnt = cpus < 1 ? 1 : cpus > NESTED_MAX_WORKERS ? NESTED_MAX_WORKERS : cpus;
+  for (int i = 0; i < pool->worker_cnt; i++) {
+    if (pthread_create(&pool->workers[i], NULL, NestedWorker, pool) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief Wait for every nested bundle queued, and those inside them
+ **/
+void NestedDrain(struct NestedPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void NestedPoolDestroy(struct NestedPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->worker_cnt; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+}
+
+void NestedReport(struct NestedPool *pool) {
+  printf("recursive: %" PRIu64 " nested bundles holding %" PRIu64 " data items, %" PRIu64
+         " invalid, %" PRIu64 " not bundles after all, %" PRIu64 " past depth %d\n",
+         pool->bundles, pool->items, pool->invalid, pool->broken, pool->too_deep,
+         pool->max_depth);
+}
+
+/**
+ * --filter name=value predicates, checked against each data item's tags as
+ * soon as its header is parsed. An item matches when, for every name, one
+ * of the values given for it is among its tags. The chunks holding nothing
+ * but the data of items that don't match are never fetched.
+ **/
+struct TagFilter {
+  int cnt;
+  char *names[FILTER_MAX];
+  char *values[FILTER_MAX];
+  DataItemSpan next;
+  void *next_ctx;
+  struct ArweaveBundle *arBundle;
+  struct StateMachine *state;
+  // tag being read, a length of -1 when it's longer than any predicate
+  char name[FILTER_TAG_MAX];
+  int name_len;
+  char value[FILTER_TAG_MAX];
+  int value_len;
+  // a bit per predicate the item's tags hold
+  uint32_t hits;
+  uint32_t drop_cap;
+  uint64_t matched;
+  uint64_t dropped;
+  // bundle bytes the fetch jumped over
+  uint64_t skipped;
+};
+
+/**
+ * @brief Add a name=value predicate
+ * @return 0 on success, -1 when it doesn't parse or there are too many
+ **/
+int FilterAdd(struct TagFilter *f, char *arg) {
+  char *eq = strchr(arg, '=');
+
+  if (eq == NULL || eq == arg || f->cnt == FILTER_MAX || eq - arg >= FILTER_TAG_MAX ||
+      strlen(eq + 1) >= FILTER_TAG_MAX) {
+    return -1;
+  }
+  *eq = 0;
+  f->names[f->cnt] = arg;
+  f->values[f->cnt] = eq + 1;
+  f->cnt++;
+  return 0;
+}
+
+/**
+ * @brief Start on a bundle, no item turned down yet
+ **/
+void FilterBegin(struct TagFilter *f, struct ArweaveBundle *arBundle, struct StateMachine *state) {
+  f->arBundle = arBundle;
+  f->state = state;
+  arBundle->skipToOffset = 0;
+  if (state->item_drop != NULL) {
+    memset(state->item_drop, 0, (f->drop_cap + 7) / 8);
+  }
+}
+
+int FilterMatches(struct TagFilter *f) {
+  int any;
+
+  for (int i = 0; i < f->cnt; i++) {
+    any = 0;
+    for (int j = 0; j < f->cnt; j++) {
+      if (strcmp(f->names[i], f->names[j]) == 0 && (f->hits >> j) & 1) {
+        any = 1;
+      }
+    }
+    if (!any) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Turn the item being parsed down, and let the fetch jump past the
+ *        chunks that hold nothing but the rest of it
+ **/
+void FilterDrop(struct TagFilter *f, struct DataItemParser *dp) {
+  struct StateMachine *state = f->state;
+  struct ArweaveBundle *arBundle = f->arBundle;
+  uint32_t cnt = dp->header->data_item_cnt;
+  uint64_t end = dp->header->starts[dp->item] + dp->header->sizes[dp->item];
+  uint64_t chunkEnd, resume;
+
+  if (state->item_drop == NULL || f->drop_cap < cnt) {
+    if ((state->item_drop = realloc(state->item_drop, (cnt + 7) / 8)) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+    memset(state->item_drop + (f->drop_cap + 7) / 8, 0, (cnt + 7) / 8 - (f->drop_cap + 7) / 8);
+    f->drop_cap = cnt;
+  }
+  state->item_drop[dp->item / 8] |= 1 << (dp->item % 8);
+  f->dropped++;
+
+  // end of the chunk the parser is in, and the chunk the next item starts in
+  chunkEnd = dp->pos == 0 ? 0 : ((dp->pos - 1) / MAX_CHUNK_SIZE + 1) * MAX_CHUNK_SIZE;
+  resume = end / MAX_CHUNK_SIZE * MAX_CHUNK_SIZE;
+  if (resume > chunkEnd) {
+    arBundle->skipToOffset = arBundle->startOffset + resume;
+  }
+}
+
+int FilterSpan(void *ctx, struct DataItemParser *dp, int field, const uint8_t *data, int len,
+               int last) {
+  struct TagFilter *f = ctx;
+  int skip;
+
+  // decided before the spans after it see the end of the header, so
+  // --recursive doesn't go gathering an item that is turned down
+  if (field == ITEM_HEADER_END && !FilterMatches(f)) {
+    dp->dropped = 1;
+    FilterDrop(f, dp);
+  }
+  skip = f->next != NULL ? f->next(f->next_ctx, dp, field, data, len, last) : 0;
+
+  switch (field) {
+  case ITEM_SIGNATURE:
+    f->hits = 0;
+    f->name_len = 0;
+    f->value_len = 0;
+    break;
+
+  case ITEM_TAG_NAME:
+  case ITEM_TAG_VALUE:
+    if (field == ITEM_TAG_NAME) {
+      NestedTagPiece(f->name, &f->name_len, data, len, FILTER_TAG_MAX);
+    } else {
+      NestedTagPiece(f->value, &f->value_len, data, len, FILTER_TAG_MAX);
+    }
+    if (field == ITEM_TAG_NAME || !last) {
+      break;
+    }
+    for (int i = 0; i < f->cnt; i++) {
+      if (f->name_len == (int)strlen(f->names[i]) && f->value_len == (int)strlen(f->values[i]) &&
+          memcmp(f->name, f->names[i], f->name_len) == 0 &&
+          memcmp(f->value, f->values[i], f->value_len) == 0) {
+        f->hits |= 1u << i;
+      }
+    }
+    f->name_len = 0;
+    f->value_len = 0;
+    break;
+
+  case ITEM_HEADER_END:
+    if (dp->dropped) {
+      return 1;
+    }
+    f->matched++;
+    return skip;
+
+  case ITEM_INVALID:
+    // no telling what its tags are
+    FilterDrop(f, dp);
+    break;
+  }
+  return skip;
+}
+
+/**
+ * @brief Move currentOffset up to where --filter or the --extract runs let
+ *        the fetch jump to
+ * @return 1 when it moved
+ **/
+int FetchJump(struct ArweaveBundle *arBundle) {
+  uint64_t to = arBundle->skipToOffset;
+
+  if (arBundle->plan != NULL) {
+    to = FetchNextWanted(arBundle, arBundle->currentOffset);
+  }
+  arBundle->skipToOffset = 0;
+  if (to <= arBundle->currentOffset) {
+    return 0;
+  }
+  if (arBundle->filter != NULL) {
+    arBundle->filter->skipped += to - arBundle->currentOffset;
+  }
+  arBundle->currentOffset = to;
+  return 1;
+}
+
+void FilterReport(struct TagFilter *f) {
+  uint64_t fetched = runStats.chunk_bytes;
+
+  printf("filter: %" PRIu64 " data items match, %" PRIu64 " don't; fetched %.1f MB, skipped "
+         "%.1f MB (%.1f%%)\n",
+         f->matched, f->dropped, fetched / 1e6, f->skipped / 1e6,
+         fetched + f->skipped > 0 ? 100.0 * f->skipped / (fetched + f->skipped) : 0);
+}
+
+/**
+ * @brief Feed the next bytes of the bundle to the header parser
+ *
+ * Chunks come in bundle order but cut the header anywhere, so a count or
+ * entry that straddles two chunks is assembled in arBundleHeader->partial.
+ * Whole fields are parsed right out of buffer. Once the last entry is in,
+ * the rest of the bundle passes through untouched, except for the bytes of
+ * an --item being extracted.
+ *
+ * @return Number of bytes consumed, always thisCnt
+ **/
+int ProcessChunk(struct ArweaveNode *arNode,
+                 struct ArweaveBundle *arBundle,
+                 struct ArweaveBundleHeader *arBundleHeader,
+                 struct StateMachine *state,
+                 int thisCnt,
+                 const char *buffer) {
+  const uint8_t *field;
+  int used = 0;
+  int want, take;
+  double started = state->header_done != 1 || state->items != NULL ? MonotonicSeconds() : 0;
+
+  while (used < thisCnt && state->header_done != 1) {
+    want = state->di_cnt_done == 1 ? 64 : 32;
+
+    if (arBundleHeader->partial_len == 0 && thisCnt - used >= want) {
+      field = (const uint8_t *)buffer + used;
+      used += want;
+    } else {
+      take = want - arBundleHeader->partial_len;
+      if (take > thisCnt - used) {
+        take = thisCnt - used;
+      }
+      memcpy(arBundleHeader->partial + arBundleHeader->partial_len, buffer + used, take);
+      arBundleHeader->partial_len += take;
+      used += take;
+      if (arBundleHeader->partial_len < want) {
+        break;
+      }
+      field = arBundleHeader->partial;
+      arBundleHeader->partial_len = 0;
+    }
+
+    if (state->di_cnt_done != 1) {
+      BundleHeaderCount(arBundle, arBundleHeader, state, field);
+    } else {
+      BundleHeaderEntry(arBundle, arBundleHeader, state, field);
+    }
+
+    if (state->di_cnt_done == 1 && arBundleHeader->entry_cnt == arBundleHeader->data_item_cnt) {
+      state->offset_done = 1;
+      state->header_done = 1;
+      BundleHeaderPrint(arBundle, arBundleHeader);
+      if (arBundle->unbundle_dir != NULL) {
+        state->item_index = 0;
+      }
+      if (arBundle->plan != NULL) {
+        // items in the rest of this chunk get written just below
+        ExtractPlanBuild(arBundle, arBundleHeader);
+      }
+    }
+  }
+  if (state->items != NULL && state->header_done == 1) {
+    if (state->items->header == NULL) {
+      DataItemParserStart(state->items, arBundleHeader);
+    }
+    DataItemParserFeed(state->items, arBundle->currentOffset - arBundle->startOffset,
+                       (const uint8_t *)buffer, thisCnt);
+  }
+  if (started > 0) {
+    StatsRecord(STAT_PARSE, MonotonicSeconds() - started);
+  }
+
+  if (state->item_index >= 0 && arBundle->unbundle_dir != NULL) {
+    UnbundleChunk(arBundle, arBundleHeader, state,
+                  arBundle->currentOffset - arBundle->startOffset, thisCnt, buffer);
+  } else if (state->item_index >= 0) {
+    WriteItemBytes(arBundleHeader, state,
+                   arBundle->currentOffset - arBundle->startOffset, thisCnt, buffer);
+  } else if (arBundle->plan != NULL) {
+    ExtractChunk(arBundle->plan, arBundle->currentOffset - arBundle->startOffset, thisCnt,
+                 buffer);
+  }
+
+  state->chunk_buffer_index += thisCnt;
+  return thisCnt;
+}
+
+/**
+ * @brief Drop the responses still queued on a pipelined connection
+ * @param[in] arNode Node the connection belongs to
+ * @param[in] conn Connection with requests in flight
+ * @param[in] pending Number of responses that haven't been read yet
+ * @return 1 if the connection is still usable afterwards
+ **/
+int DrainPipeline(struct ArweaveNode *arNode, struct ArweaveConnection *conn, int pending) {
+  struct HttpResponse res;
+
+  res.keep_alive = 1;
+  while (pending-- > 0 && res.keep_alive) {
+    HttpResponseInit(&res, NULL, NULL);
+    if (ReadResponse(arNode, conn, &res) == 0) {
+      return 0;
+    }
+  }
+  return res.keep_alive;
+}
+
+/*
+ * String scanning for the /chunk JSON. Inside a string only '"' and '\\'
+ * matter, so the kernels look for the first of either, 16 or 32 bytes at
+ * a time, and return its index, or len if there is none.
+ */
+typedef int (*JsonStringKernel)(const char *p, int len);
+
+static int JsonStringSpanScalar(const char *p, int len) {
+  for (int i = 0; i < len; i++) {
+    if (p[i] == '"' || p[i] == '\\') {
+      return i;
+    }
+  }
+  return len;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+static int JsonStringSpanSse2(const char *p, int len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  int i = 0;
+  int mask;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+
+    mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + JsonStringSpanScalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static int JsonStringSpanAvx2(const char *p, int len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  uint64_t mask;
+  int i = 0;
+
+  // two vectors per round, a base64url value is tens of kilobytes of nothing
+  for (; i + 64 <= len; i += 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+    __m256i hitA = _mm256_or_si256(_mm256_cmpeq_epi8(a, quote), _mm256_cmpeq_epi8(a, backslash));
+    __m256i hitB = _mm256_or_si256(_mm256_cmpeq_epi8(b, quote), _mm256_cmpeq_epi8(b, backslash));
+
+    if (!_mm256_testz_si256(_mm256_or_si256(hitA, hitB), _mm256_or_si256(hitA, hitB))) {
+      mask = (uint32_t)_mm256_movemask_epi8(hitA) |
+             ((uint64_t)(uint32_t)_mm256_movemask_epi8(hitB) << 32);
+      return i + __builtin_ctzll(mask);
+    }
+  }
+  return i + JsonStringSpanSse2(p + i, len - i);
+}
+
+#endif
+
+static JsonStringKernel jsonStringKernel;
+static const char *jsonStringKernelName = "scalar";
+
+void JsonSelectKernel(void) {
+  jsonStringKernel = JsonStringSpanScalar;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    jsonStringKernel = JsonStringSpanAvx2;
+    jsonStringKernelName = "avx2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    jsonStringKernel = JsonStringSpanSse2;
+    jsonStringKernelName = "sse2";
+  }
+#endif
+}
+
+// Fields of a /chunk response the scanner reports the values of
+enum ChunkJsonField {
+  CHUNK_JSON_CHUNK,
+  CHUNK_JSON_DATA_PATH,
+  CHUNK_JSON_TX_PATH,
+  CHUNK_JSON_FIELDS
+};
+
+static const char *chunkJsonFieldNames[CHUNK_JSON_FIELDS] = {"chunk", "data_path", "tx_path"};
+
+// Where ChunkJsonScanner is in the body
+enum ChunkJsonState {
+  CHUNK_JSON_OBJECT,
+  CHUNK_JSON_MEMBER,
+  CHUNK_JSON_KEY,
+  CHUNK_JSON_COLON,
+  CHUNK_JSON_VALUE,
+  CHUNK_JSON_STRING,
+  CHUNK_JSON_SCALAR,
+  CHUNK_JSON_NESTED,
+  CHUNK_JSON_NESTED_STRING,
+  CHUNK_JSON_NEXT,
+  CHUNK_JSON_END,
+  CHUNK_JSON_ERROR
+};
+
+/**
+ * Receives the value of a field as it streams by, in spans pointing right
+ * into the buffer the scanner was fed. last is set on the span that ends
+ * the value, which may be empty. Escapes are passed on as they are.
+ * Returning -1 stops the scan.
+ **/
+typedef int (*ChunkJsonSpan)(void *ctx, int field, const char *data, int len, int last);
+
+/**
+ * Streaming scanner for the JSON object of a /chunk response. It walks the
+ * top level members across however the body was sliced and hands the
+ * string values of the chunk, data_path and tx_path keys to span as they
+ * arrive. Everything else is skipped, strings a vector at a time.
+ **/
+struct ChunkJsonScanner {
+  int state;
+  // a backslash ended the last slice, the next byte is escaped
+  int escaped;
+  // brackets open inside a skipped object or array value
+  int depth;
+  // field of the string value being read, -1 for one nobody asked for
+  int field;
+  char key[16];
+  // -1 once the key is longer than any field name
+  int key_len;
+  ChunkJsonSpan span;
+  void *ctx;
+};
+
+void ChunkJsonInit(struct ChunkJsonScanner *js, ChunkJsonSpan span, void *ctx) {
+  js->state = CHUNK_JSON_OBJECT;
+  js->escaped = 0;
+  js->depth = 0;
+  js->field = -1;
+  js->key_len = 0;
+  js->span = span;
+  js->ctx = ctx;
+  if (jsonStringKernel == NULL) {
+    JsonSelectKernel();
+  }
+}
+
+/**
+ * @brief Find where the string the scanner is in ends
+ * @param[out] closed Set when the closing quote is in data
+ * @return Number of bytes of string content in data, escapes included
+ **/
+int ChunkJsonStringEnd(struct ChunkJsonScanner *js, const char *data, int len, int *closed) {
+  int i = 0;
+
+  *closed = 0;
+  if (js->escaped) {
+    if (len == 0) {
+      return 0;
+    }
+    js->escaped = 0;
+    i = 1;
+  }
+  for (;;) {
+    i += jsonStringKernel(data + i, len - i);
+    if (i == len) {
+      return i;
+    }
+    if (data[i] == '"') {
+      *closed = 1;
+      return i;
+    }
+    // a backslash, skip what it escapes
+    if (i + 1 == len) {
+      js->escaped = 1;
+      return len;
+    }
+    i += 2;
+  }
+}
+
+int ChunkJsonFieldOf(struct ChunkJsonScanner *js) {
+  for (int f = 0; f < CHUNK_JSON_FIELDS; f++) {
+    if (js->key_len == (int)strlen(chunkJsonFieldNames[f]) &&
+        memcmp(js->key, chunkJsonFieldNames[f], js->key_len) == 0) {
+      return f;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Feed the next slice of the body to the scanner
+ * @return 0 to go on, -1 on malformed JSON or when span said to stop
+ **/
+int ChunkJsonFeed(struct ChunkJsonScanner *js, const char *data, int len) {
+  int i = 0;
+  int n, closed;
+  char c;
+
+  while (i < len) {
+    c = data[i];
+    switch (js->state) {
+    case CHUNK_JSON_OBJECT:
+      if (c == '{') {
+        js->state = CHUNK_JSON_MEMBER;
+      } else if (!isspace((unsigned char)c)) {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i++;
+      break;
+
+    case CHUNK_JSON_MEMBER:
+      if (c == '"') {
+        js->state = CHUNK_JSON_KEY;
+        js->key_len = 0;
+      } else if (c == '}') {
+        js->state = CHUNK_JSON_END;
+      } else if (!isspace((unsigned char)c) && c != ',') {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i++;
+      break;
+
+    case CHUNK_JSON_KEY:
+      n = ChunkJsonStringEnd(js, data + i, len - i, &closed);
+      if (js->key_len >= 0 && js->key_len + n <= (int)sizeof(js->key)) {
+        memcpy(js->key + js->key_len, data + i, n);
+        js->key_len += n;
+      } else {
+        js->key_len = -1;
+      }
+      i += n;
+      if (closed) {
+        js->field = ChunkJsonFieldOf(js);
+        js->state = CHUNK_JSON_COLON;
+        i++;
+      }
+      break;
+
+    case CHUNK_JSON_COLON:
+      if (c == ':') {
+        js->state = CHUNK_JSON_VALUE;
+      } else if (!isspace((unsigned char)c)) {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i++;
+      break;
+
+    case CHUNK_JSON_VALUE:
+      if (c == '"') {
+        js->state = CHUNK_JSON_STRING;
+        i++;
+      } else if (c == '{' || c == '[') {
+        js->state = CHUNK_JSON_NESTED;
+        js->depth = 1;
+        i++;
+      } else if (isspace((unsigned char)c)) {
+        i++;
+      } else {
+        js->state = CHUNK_JSON_SCALAR;
+      }
+      break;
+
+    case CHUNK_JSON_STRING:
+      n = ChunkJsonStringEnd(js, data + i, len - i, &closed);
+      if (js->field >= 0 && (n > 0 || closed) &&
+          js->span(js->ctx, js->field, data + i, n, closed) == -1) {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i += n;
+      if (closed) {
+        js->state = CHUNK_JSON_NEXT;
+        i++;
+      }
+      break;
+
+    case CHUNK_JSON_SCALAR:
+      if (c == ',' || c == '}' || isspace((unsigned char)c)) {
+        js->state = CHUNK_JSON_NEXT;
+      } else {
+        i++;
+      }
+      break;
+
+    case CHUNK_JSON_NESTED:
+      if (c == '"') {
+        js->state = CHUNK_JSON_NESTED_STRING;
+      } else if (c == '{' || c == '[') {
+        js->depth++;
+      } else if ((c == '}' || c == ']') && --js->depth == 0) {
+        js->state = CHUNK_JSON_NEXT;
+      }
+      i++;
+      break;
+
+    case CHUNK_JSON_NESTED_STRING:
+      i += ChunkJsonStringEnd(js, data + i, len - i, &closed);
+      if (closed) {
+        js->state = CHUNK_JSON_NESTED;
+        i++;
+      }
+      break;
+
+    case CHUNK_JSON_NEXT:
+      if (c == ',') {
+        js->state = CHUNK_JSON_MEMBER;
+      } else if (c == '}') {
+        js->state = CHUNK_JSON_END;
+      } else if (!isspace((unsigned char)c)) {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i++;
+      break;
+
+    case CHUNK_JSON_END:
+      // trailing whitespace is all there may be
+      if (!isspace((unsigned char)c)) {
+        js->state = CHUNK_JSON_ERROR;
+        return -1;
+      }
+      i++;
+      break;
+
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Progress of ChunkFieldSink through a /chunk JSON body
+enum ChunkFieldState {
+  CHUNK_FIELD_KEY,
+  CHUNK_FIELD_VALUE,
+  CHUNK_FIELD_DONE,
+  CHUNK_FIELD_ERROR
+};
+
+/**
+ * Body consumer for /chunk responses. The JSON scanner picks the "chunk"
+ * value out of however the body was sliced by recv() and it streams
+ * through the decoder as it arrives, so only the decoded chunk is kept.
+ **/
+struct ChunkFieldSink {
+  int state;
+  struct ChunkJsonScanner json;
+  struct Base64urlStream b64;
+  char *out;
+  int len;
+  int cap;
+  // --verify, where the data_path is decoded to, NULL to skip it; its
+  // length is -1 once it doesn't fit in DATA_PATH_MAX_SIZE
+  char *path;
+  int path_len;
+  struct Base64urlStream path_b64;
+  // time spent decoding so far
+  double decode_secs;
+};
+
+/**
+ * @brief Decode the next span of the data_path value
+ * @return 0 on success, -1 on a character outside the alphabet
+ **/
+int ChunkFieldSinkPath(struct ChunkFieldSink *sink, const char *data, int len, int last) {
+  int n;
+
+  if (sink->path_len == -1) {
+    return 0;
+  }
+  if (sink->path_len + (sink->path_b64.carry_len + len) / 4 * 3 + 3 > DATA_PATH_MAX_SIZE) {
+    sink->path_len = -1;
+    return 0;
+  }
+  if ((n = base64urlStreamUpdate(&sink->path_b64, data, len, sink->path + sink->path_len)) == -1) {
+    return -1;
+  }
+  sink->path_len += n;
+  if (last) {
+    if ((n = base64urlStreamFinal(&sink->path_b64, sink->path + sink->path_len)) == -1) {
+      return -1;
+    }
+    sink->path_len += n;
+  }
+  return 0;
+}
+
+int ChunkFieldSinkSpan(void *ctx, int field, const char *data, int len, int last) {
+  struct ChunkFieldSink *sink = (struct ChunkFieldSink *)ctx;
+  double started;
+  int n;
+
+  if (field == CHUNK_JSON_DATA_PATH && sink->path != NULL) {
+    return ChunkFieldSinkPath(sink, data, len, last);
+  }
+  if (field != CHUNK_JSON_CHUNK) {
+    return 0;
+  }
+  if (sink->state == CHUNK_FIELD_DONE) {
+    // a second "chunk" key, which of the two is meant?
+    return -1;
+  }
+  sink->state = CHUNK_FIELD_VALUE;
+  if (sink->len + (sink->b64.carry_len + len) / 4 * 3 > sink->cap) {
+    return -1;
+  }
+  started = MonotonicSeconds();
+  if ((n = base64urlStreamUpdate(&sink->b64, data, len, sink->out + sink->len)) == -1) {
+    return -1;
+  }
+  sink->len += n;
+  if (last) {
+    if (sink->len + sink->b64.carry_len * 3 / 4 > sink->cap ||
+        (n = base64urlStreamFinal(&sink->b64, sink->out + sink->len)) == -1) {
+      return -1;
+    }
+    sink->len += n;
+    sink->state = CHUNK_FIELD_DONE;
+  }
+  sink->decode_secs += MonotonicSeconds() - started;
+  if (last) {
+    StatsRecord(STAT_DECODE, sink->decode_secs);
+  }
+  return 0;
+}
+
+void ChunkFieldSinkInit(struct ChunkFieldSink *sink, char *out, int cap) {
+  sink->state = CHUNK_FIELD_KEY;
+  ChunkJsonInit(&sink->json, ChunkFieldSinkSpan, sink);
+  base64urlStreamInit(&sink->b64);
+  sink->out = out;
+  sink->len = 0;
+  sink->cap = cap;
+  sink->path = NULL;
+  sink->path_len = 0;
+  base64urlStreamInit(&sink->path_b64);
+  sink->decode_secs = 0;
+}
+
+int ChunkFieldSinkWrite(void *ctx, const char *data, int len) {
+  struct ChunkFieldSink *sink = (struct ChunkFieldSink *)ctx;
+
+  if (ChunkJsonFeed(&sink->json, data, len) == -1) {
+    sink->state = CHUNK_FIELD_ERROR;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * The byte at a time "chunk" key matcher ChunkFieldSink used before the
+ * JSON scanner, kept as the baseline --bench-json measures against.
+ **/
+struct CrudeChunkField {
+  int state;
+  int matched;
+  struct Base64urlStream b64;
+  char *out;
+  int len;
+};
+
+static int CrudeChunkFieldWrite(struct CrudeChunkField *sink, const char *data, int len) {
+  const char *chunk_token = "\"chunk\"";
+  const char *quote;
+  int i = 0;
+  int n;
+
+  while (i < len) {
+    switch (sink->state) {
+    case 0:
+      if (data[i] == chunk_token[sink->matched]) {
+        if (++sink->matched == 7) {
+          sink->state = 1;
+        }
+      } else {
+        sink->matched = data[i] == '"';
+      }
+      i++;
+      break;
+
+    case 1:
+      if (data[i] == '"') {
+        sink->state = 2;
+      } else if (data[i] != ':' && !isspace((unsigned char)data[i])) {
+        return -1;
+      }
+      i++;
+      break;
+
+    case 2:
+      quote = memchr(data + i, '"', len - i);
+      n = (quote ? quote - data : len) - i;
+      if ((n = base64urlStreamUpdate(&sink->b64, data + i, n, sink->out + sink->len)) == -1) {
+        return -1;
+      }
+      sink->len += n;
+      if (quote == NULL) {
+        return 0;
+      }
+      if ((n = base64urlStreamFinal(&sink->b64, sink->out + sink->len)) == -1) {
+        return -1;
+      }
+      sink->len += n;
+      sink->state = 3;
+      return 0;
+
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static int BenchJsonSpanCount(void *ctx, int field, const char *data, int len, int last) {
+  uint64_t *lens = ctx;
+
+  (void)data;
+  (void)last;
+  lens[field] += len;
+  return 0;
+}
+
+/**
+ * @brief --bench-json: /chunk body scanning, old matcher against the scanner
+ *
+ * The body carries tx_path and data_path ahead of the chunk, like a node's,
+ * and is fed in HTTP_READ_BUFFER_SIZE slices, the way recv() hands it over.
+ **/
+int BenchChunkJson(void) {
+  const int iterations = 2000;
+  const int pathLen = 1120;
+  uint8_t *raw = malloc(MAX_CHUNK_SIZE);
+  char *body = malloc(MAX_CHUNK_SIZE * 4 / 3 + 4 * pathLen + 256);
+  char *decoded = malloc(MAX_CHUNK_SIZE + 64);
+  int bodyLen = 0;
+  uint64_t lens[CHUNK_JSON_FIELDS];
+  struct ChunkFieldSink sink;
+  struct CrudeChunkField crude;
+  struct ChunkJsonScanner js;
+  JsonStringKernel best;
+  const char *bestName;
+  double start, crudeSecs, sinkSecs, secs;
+  struct {
+    const char *name;
+    JsonStringKernel kernel;
+  } kernels[3];
+  int kernelCnt = 0;
+
+  srand(1984);
+  for (int i = 0; i < MAX_CHUNK_SIZE; i++) {
+    raw[i] = rand() & 0xFF;
+  }
+  bodyLen += sprintf(body, "{\"tx_path\":\"");
+  bodyLen += base64urlEncode(raw, pathLen, body + bodyLen);
+  bodyLen += sprintf(body + bodyLen, "\",\"packing\":\"unpacked\",\"data_path\":\"");
+  bodyLen += base64urlEncode(raw + pathLen, pathLen, body + bodyLen);
+  bodyLen += sprintf(body + bodyLen, "\",\"chunk\":\"");
+  bodyLen += base64urlEncode(raw, MAX_CHUNK_SIZE, body + bodyLen);
+  bodyLen += sprintf(body + bodyLen, "\"}");
+  JsonSelectKernel();
+  best = jsonStringKernel;
+  bestName = jsonStringKernelName;
+
+  start = MonotonicSeconds();
+  for (int i = 0; i < iterations; i++) {
+    memset(&crude, 0, sizeof(crude));
+    crude.out = decoded;
+    for (int n = 0; n < bodyLen; n += HTTP_READ_BUFFER_SIZE) {
+      CrudeChunkFieldWrite(&crude, body + n,
+                           bodyLen - n < HTTP_READ_BUFFER_SIZE ? bodyLen - n : HTTP_READ_BUFFER_SIZE);
+    }
+  }
+  crudeSecs = MonotonicSeconds() - start;
+  if (crude.len != MAX_CHUNK_SIZE || memcmp(decoded, raw, MAX_CHUNK_SIZE) != 0) {
+    fprintf(stderr, "crude scanner mismatch\n");
+    return EXIT_FAILURE;
+  }
+
+  memset(decoded, 0, MAX_CHUNK_SIZE);
+  start = MonotonicSeconds();
+  for (int i = 0; i < iterations; i++) {
+    ChunkFieldSinkInit(&sink, decoded, MAX_CHUNK_SIZE);
+    for (int n = 0; n < bodyLen; n += HTTP_READ_BUFFER_SIZE) {
+      ChunkFieldSinkWrite(&sink, body + n,
+                          bodyLen - n < HTTP_READ_BUFFER_SIZE ? bodyLen - n : HTTP_READ_BUFFER_SIZE);
+    }
+  }
+  sinkSecs = MonotonicSeconds() - start;
+  if (sink.state != CHUNK_FIELD_DONE || sink.len != MAX_CHUNK_SIZE ||
+      memcmp(decoded, raw, MAX_CHUNK_SIZE) != 0) {
+    fprintf(stderr, "JSON scanner mismatch\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("/chunk body, %d bodies of %d bytes\n", iterations, bodyLen);
+  printf("  crude matcher + decode: %.3f GB/s\n", (double)bodyLen * iterations / crudeSecs / 1e9);
+  printf("  %s scanner + decode: %.3f GB/s\n", bestName,
+         (double)bodyLen * iterations / sinkSecs / 1e9);
+
+  kernels[kernelCnt].name = "scalar";
+  kernels[kernelCnt++].kernel = JsonStringSpanScalar;
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("sse2")) {
+    kernels[kernelCnt].name = "sse2";
+    kernels[kernelCnt++].kernel = JsonStringSpanSse2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels[kernelCnt].name = "avx2";
+    kernels[kernelCnt++].kernel = JsonStringSpanAvx2;
+  }
+#endif
+  for (int k = 0; k < kernelCnt; k++) {
+    jsonStringKernel = kernels[k].kernel;
+    start = MonotonicSeconds();
+    for (int i = 0; i < iterations; i++) {
+      memset(lens, 0, sizeof(lens));
+      ChunkJsonInit(&js, BenchJsonSpanCount, lens);
+      // odd slices on the last round, so keys and escapes get cut anywhere
+      for (int n = 0, step = i + 1 < iterations ? HTTP_READ_BUFFER_SIZE : 7; n < bodyLen;
+           n += step) {
+        ChunkJsonFeed(&js, body + n, bodyLen - n < step ? bodyLen - n : step);
+      }
+    }
+    secs = MonotonicSeconds() - start;
+    if (js.state != CHUNK_JSON_END || lens[CHUNK_JSON_TX_PATH] != (uint64_t)(pathLen * 4 + 2) / 3 ||
+        lens[CHUNK_JSON_DATA_PATH] != (uint64_t)(pathLen * 4 + 2) / 3 ||
+        lens[CHUNK_JSON_CHUNK] != (uint64_t)(MAX_CHUNK_SIZE * 4 + 2) / 3) {
+      fprintf(stderr, "%s scanner mismatch\n", kernels[k].name);
+      return EXIT_FAILURE;
+    }
+    printf("  %s field scan only: %.3f GB/s\n", kernels[k].name,
+           (double)bodyLen * iterations / secs / 1e9);
+  }
+  jsonStringKernel = best;
+
+  free(raw);
+  free(body);
+  free(decoded);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Checks the Merkle proofs of /chunk responses off the fetch loop for
+ * --verify. The fetch loop copies each chunk and its decoded data_path into
+ * an idle job and goes on; worker threads hash it against the data_root of
+ * the bundle. Jobs are few, so the fetch loop only waits on them when the
+ * workers fall behind.
+ **/
+struct VerifyJob {
+  uint64_t pos;
+  char *chunk;
+  int len;
+  int path_len;
+  uint8_t path[DATA_PATH_MAX_SIZE];
+};
+
+struct ChunkVerifier {
+  pthread_mutex_t lock;
+  // a job was queued, or the workers are to stop
+  pthread_cond_t work;
+  // a job went back to idle
+  pthread_cond_t done;
+  struct VerifyJob *jobs;
+  // queued jobs, oldest at head, and the idle ones
+  struct VerifyJob *queue[VERIFY_QUEUE_DEPTH];
+  int head;
+  int cnt;
+  struct VerifyJob *idle[VERIFY_QUEUE_DEPTH];
+  int idle_cnt;
+  int stopping;
+  pthread_t workers[VERIFY_MAX_WORKERS];
+  int worker_cnt;
+  // bundle the queued chunks belong to
+  char tx_id[256];
+  uint8_t data_root[32];
+  uint64_t start_offset;
+  uint64_t size;
+  uint64_t verified;
+  uint64_t failed;
+  // chunks that came out of the --cache, which keeps no proofs
+  uint64_t unchecked;
+  // first chunk queued, last one checked, and how long the fetch loop
+  // waited for an idle job
+  double first_at;
+  double last_at;
+  double stalled;
+};
+
+/**
+ * @brief Read a 32 byte big endian offset off a Merkle tree node
+ * @return 0 on success, -1 if it doesn't fit in 64 bits
+ **/
+int ReadNote(const uint8_t *note, uint64_t *value) {
+  *value = 0;
+  for (int i = 0; i < 24; i++) {
+    if (note[i] != 0) {
+      return -1;
+    }
+  }
+  for (int i = 24; i < 32; i++) {
+    *value = (*value << 8) | note[i];
+  }
+  return 0;
+}
+
+/**
+ * @brief Id of a Merkle tree node: the hash of the hashes of its n parts
+ **/
+void MerkleNodeId(const uint8_t *parts, int n, uint8_t id[32]) {
+  uint8_t hashes[3 * 32];
+
+  for (int i = 0; i < n; i++) {
+    Sha256(parts + 32 * i, 32, hashes + 32 * i);
+  }
+  Sha256(hashes, 32 * n, id);
+}
+
+/**
+ * @brief Check a chunk against the data_root of its bundle
+ *
+ * The data_path is walked from the root down. Each branch is (left id,
+ * right id, offset) and has to hash to the id expected of it; the walk goes
+ * left when the chunk starts before the offset, which also narrows where
+ * the chunk may lie. The leaf is (chunk hash, end offset).
+ *
+ * @param[in] pos Bundle relative offset of the chunk's first byte
+ * @return NULL if the chunk checks out, otherwise what's wrong with it
+ **/
+const char *VerifyChunkProof(const uint8_t root[32], uint64_t size, uint64_t pos,
+                             const uint8_t *chunk, int len, const uint8_t *path, int pathLen) {
+  uint8_t expect[32], id[32];
+  uint64_t left = 0, right = size;
+  uint64_t note;
+
+  if (pathLen < 0) {
+    return "data_path is too long";
+  }
+  if (pathLen < 64 || (pathLen - 64) % 96 != 0) {
+    return "data_path is missing or cut short";
+  }
+  memcpy(expect, root, 32);
+  for (; pathLen > 64; path += 96, pathLen -= 96) {
+    MerkleNodeId(path, 3, id);
+    if (memcmp(id, expect, 32) != 0) {
+      return "data_path doesn't hash to the data_root";
+    }
+    if (ReadNote(path + 64, &note) == -1) {
+      return "data_path holds an offset past 2^64";
+    }
+    if (pos < note) {
+      memcpy(expect, path, 32);
+      right = note < right ? note : right;
+    } else {
+      memcpy(expect, path + 32, 32);
+      left = note > left ? note : left;
+    }
+  }
+
+  MerkleNodeId(path, 2, id);
+  if (memcmp(id, expect, 32) != 0) {
+    return "data_path doesn't hash to the data_root";
+  }
+  if (ReadNote(path + 32, &note) == -1) {
+    return "data_path holds an offset past 2^64";
+  }
+  if (left != pos || (note < right ? note : right) != pos + len) {
+    return "data_path puts the chunk somewhere else";
+  }
+  Sha256(chunk, len, id);
+  if (memcmp(id, path, 32) != 0) {
+    return "chunk doesn't match the hash in its data_path";
+  }
+  return NULL;
+}
+
+void *VerifyWorker(void *arg) {
+  struct ChunkVerifier *v = arg;
+  struct VerifyJob *job;
+  const char *error;
+
+  pthread_mutex_lock(&v->lock);
+  for (;;) {
+    while (v->cnt == 0 && !v->stopping) {
+      pthread_cond_wait(&v->work, &v->lock);
+    }
+    if (v->cnt == 0) {
+      break;
+    }
+    job = v->queue[v->head];
+    v->head = (v->head + 1) % VERIFY_QUEUE_DEPTH;
+    v->cnt--;
+    pthread_mutex_unlock(&v->lock);
+
+    error = VerifyChunkProof(v->data_root, v->size, job->pos, (const uint8_t *)job->chunk,
+                             job->len, job->path, job->path_len);
+    if (error != NULL) {
+      fprintf(stderr, "chunk at %" PRIu64 " of %s fails verification: %s\n", job->pos, v->tx_id,
+              error);
+    }
+    ChunkPoolRelease(&chunkPool, job->chunk);
+
+    pthread_mutex_lock(&v->lock);
+    if (error != NULL) {
+      v->failed++;
+    } else {
+      v->verified++;
+    }
+    v->last_at = MonotonicSeconds();
+    v->idle[v->idle_cnt++] = job;
+    pthread_cond_signal(&v->done);
+  }
+  pthread_mutex_unlock(&v->lock);
+  return NULL;
+}
+
+/**
+ * @brief Start a worker per CPU, VERIFY_MAX_WORKERS at most
+ **/
+void VerifierInit(struct ChunkVerifier *v) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  memset(v, 0, sizeof(*v));
+  pthread_mutex_init(&v->lock, NULL);
+  pthread_cond_init(&v->work, NULL);
+  pthread_cond_init(&v->done, NULL);
+  if ((v->jobs = malloc(VERIFY_QUEUE_DEPTH * sizeof(struct VerifyJob))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (int i = 0; i < VERIFY_QUEUE_DEPTH; i++) {
+    v->idle[v->idle_cnt++] = &v->jobs[i];
+  }
+  v->worker_cnt = cpus < 1 ? 1 : cpus > VERIFY_MAX_WORKERS ? VERIFY_MAX_WORKERS : cpus;
+  for (int i = 0; i < v->worker_cnt; i++) {
+    if (pthread_create(&v->workers[i], NULL, VerifyWorker, v) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief Wait for every queued chunk to be checked
+ **/
+void VerifierDrain(struct ChunkVerifier *v) {
+  pthread_mutex_lock(&v->lock);
+  while (v->idle_cnt < VERIFY_QUEUE_DEPTH) {
+    pthread_cond_wait(&v->done, &v->lock);
+  }
+  pthread_mutex_unlock(&v->lock);
+}
+
+/**
+ * @brief Queue a chunk fetched from a node for checking
+ * @param[in] offset Weave offset of the chunk's first byte
+ * @param[in] path Decoded data_path, pathLen -1 if it didn't fit
+ **/
+void VerifierSubmit(struct ChunkVerifier *v, uint64_t offset, const char *chunk, int len,
+                    const char *path, int pathLen) {
+  struct VerifyJob *job;
+  double started = 0;
+
+  pthread_mutex_lock(&v->lock);
+  if (v->idle_cnt == 0) {
+    started = MonotonicSeconds();
+  }
+  while (v->idle_cnt == 0) {
+    pthread_cond_wait(&v->done, &v->lock);
+  }
+  job = v->idle[--v->idle_cnt];
+  if (started > 0) {
+    v->stalled += MonotonicSeconds() - started;
+  }
+  if (v->first_at == 0) {
+    v->first_at = MonotonicSeconds();
+  }
+  pthread_mutex_unlock(&v->lock);
+
+  job->pos = offset - v->start_offset;
+  job->chunk = ChunkPoolAcquire(&chunkPool);
+  memcpy(job->chunk, chunk, len);
+  job->len = len;
+  job->path_len = pathLen;
+  if (pathLen > 0) {
+    memcpy(job->path, path, pathLen);
+  }
+
+  pthread_mutex_lock(&v->lock);
+  v->queue[(v->head + v->cnt) % VERIFY_QUEUE_DEPTH] = job;
+  v->cnt++;
+  pthread_cond_signal(&v->work);
+  pthread_mutex_unlock(&v->lock);
+}
+
+/**
+ * @brief Count a chunk that can't be checked
+ **/
+void VerifierUnchecked(struct ChunkVerifier *v) {
+  pthread_mutex_lock(&v->lock);
+  v->unchecked++;
+  pthread_mutex_unlock(&v->lock);
+}
+
+/**
+ * @brief Ask a node for the data_root of a bundle
+ *
+ * /tx/<id>/data_root answers with the root in base64url, taken with or
+ * without quotes around it.
+ **/
+void GetDataRoot(struct ArweaveNode *arNode, struct ArweaveBundle *arBundle, uint8_t root[32]) {
+  struct ArweaveConnection conn;
+  struct HttpResponse res;
+  char path[300];
+  char body[256];
+  struct PageSink sink = {body, 0, sizeof(body) - 1, 0};
+  char raw[48];
+  char *start, *end;
+  int status, rootLen;
+
+  snprintf(path, sizeof(path), "tx/%s/data_root", arBundle->tx_id);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    conn = PoolAcquire(arNode);
+    if (SendRequest(arNode, &conn, path) == -1) {
+      perror("send");
+      exit(2);
+    }
+    sink.len = 0;
+    HttpResponseInit(&res, PageSinkWrite, &sink);
+    status = ReadResponse(arNode, &conn, &res);
+    PoolRelease(arNode, &conn, status != 0 && res.keep_alive);
+    // a stale pooled connection gets one more go on a fresh one
+    if (status != 0 || !conn.reused) {
+      break;
+    }
+  }
+
+  body[sink.len] = 0;
+  for (start = body; *start == '"' || isspace((unsigned char)*start); start++) {
+  }
+  for (end = start; *end != 0 && *end != '"' && !isspace((unsigned char)*end); end++) {
+  }
+  if (status != 200 || sink.overflow ||
+      !base64urlDecode(start, end - start, raw, &rootLen) || rootLen != 32) {
+    fprintf(stderr, "couldn't get the data_root of %s from %s to verify against\n",
+            arBundle->tx_id, arNode->domain);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(root, raw, 32);
+}
+
+/**
+ * @brief Get ready to check the chunks of the bundle about to be fetched
+ **/
+void VerifierBegin(struct ChunkVerifier *v, struct ArweaveNode *arNode,
+                   struct ArweaveBundle *arBundle) {
+  // the workers read the bundle fields, so the previous one has to be done
+  VerifierDrain(v);
+  GetDataRoot(arNode, arBundle, v->data_root);
+  strcpy(v->tx_id, arBundle->tx_id);
+  v->start_offset = arBundle->startOffset;
+  v->size = arBundle->size;
+}
+
+void VerifierReport(struct ChunkVerifier *v) {
+  double elapsed = v->last_at - v->first_at;
+
+  printf("verified %" PRIu64 " chunks, %" PRIu64 " failed, %" PRIu64
+         " from the cache unchecked, %.1f chunks/sec on %d workers (sha256 %s), "
+         "fetching waited %.2f s\n",
+         v->verified, v->failed, v->unchecked,
+         elapsed > 0 ? (v->verified + v->failed) / elapsed : 0.0, v->worker_cnt,
+         sha256KernelName, v->stalled);
+}
+
+/**
+ * @brief Check what's still queued, then stop the workers
+ **/
+void VerifierDestroy(struct ChunkVerifier *v) {
+  pthread_mutex_lock(&v->lock);
+  v->stopping = 1;
+  pthread_cond_broadcast(&v->work);
+  pthread_mutex_unlock(&v->lock);
+  for (int i = 0; i < v->worker_cnt; i++) {
+    pthread_join(v->workers[i], NULL);
+  }
+  free(v->jobs);
+  v->jobs = NULL;
+}
+
+/**
+ * @brief Read one /chunk response, decoding its "chunk" value on the fly
+ * @param[in] arNode Node the connection belongs to
+ * @param[in] conn Connection with the request already written
+ * @param[in] offset Weave offset the request asked for
+ * @param[out] chunk Receives the decoded chunk, MAX_CHUNK_SIZE bytes at most
+ * @param[out] chunkLen Number of decoded bytes
+ * @param[out] keepAlive Whether conn can carry further requests
+ * @param[in] verifier Gets the chunk and its proof with --verify, else NULL
+ * @return HTTP status, 0 when the node hung up before answering, -1 when
+ *         the answer holds no usable chunk
+ **/
+int ReadChunkResponse(struct ArweaveNode *arNode, struct ArweaveConnection *conn,
+                      uint64_t offset, char *chunk, int *chunkLen, int *keepAlive,
+                      struct ChunkVerifier *verifier) {
+  struct HttpResponse res;
+  struct ChunkFieldSink sink;
+  char path[DATA_PATH_MAX_SIZE];
+  int status;
+
+  ChunkFieldSinkInit(&sink, chunk, MAX_CHUNK_SIZE);
+  if (verifier != NULL) {
+    sink.path = path;
+  }
+  HttpResponseInit(&res, ChunkFieldSinkWrite, &sink);
+  status = ReadResponse(arNode, conn, &res);
+
+  if (sink.state == CHUNK_FIELD_ERROR) {
+    fprintf(stderr, "chunk offset %" PRId64 " has a malformed chunk in its response\n", offset);
+    return -1;
+  }
+  if (status == 0) {
+    return 0;
+  }
+
+  if (status >= 400 && status < 500) {
+    fprintf(stderr, "chunk offset %" PRId64 " wasn't found\n", offset);
+    return -1;
+  }
+  if (sink.state != CHUNK_FIELD_DONE) {
+    fprintf(stderr, "chunk offset %" PRId64 " has no chunk in its response\n", offset);
+    return -1;
+  }
+  *keepAlive = res.keep_alive;
+  *chunkLen = sink.len;
+  if (verifier != NULL) {
+    VerifierSubmit(verifier, offset, chunk, sink.len, path, sink.path_len);
+  }
+  return status;
+}
+
+/**
+ * @brief Read one /raw range response straight into the chunk buffer
+ * @param[in] arNode Node the connection belongs to
+ * @param[in] conn Connection with the request already written
+ * @param[in] offset Weave offset the range starts at
+ * @param[out] chunk Receives the bytes, MAX_CHUNK_SIZE at most
+ * @param[out] chunkLen Number of bytes received
+ * @param[out] keepAlive Whether conn can carry further requests
+ * @return HTTP status, 0 when the node hung up before answering, -1 when
+ *         the answer isn't the range asked for
+ **/
+int ReadRawResponse(struct ArweaveNode *arNode, struct ArweaveConnection *conn,
+                    uint64_t offset, char *chunk, int *chunkLen, int *keepAlive) {
+  struct HttpResponse res;
+  int status;
+
+  HttpResponseInit(&res, NULL, NULL);
+  HttpResponseDirect(&res, chunk, MAX_CHUNK_SIZE);
+  status = ReadResponse(arNode, conn, &res);
+
+  if (status == 0 && res.status == 0) {
+    return 0;
+  }
+  if (res.status != 206) {
+    // a node that ignores Range answers 200 with the whole tx
+    fprintf(stderr, "range at offset %" PRId64 " came back with status %d\n", offset,
+            res.status);
+    return -1;
+  }
+  if (status == 0) {
+    fprintf(stderr, "range at offset %" PRId64 " was cut short or is longer than a chunk\n",
+            offset);
+    return -1;
+  }
+  *keepAlive = res.keep_alive;
+  *chunkLen = res.body_len;
+  return status;
+}
+
+/**
+ * On-disk layout of a --resume checkpoint: this record, then the done
+ * bitmap, then the sizes, ids and starts of the header entries parsed.
+ **/
+struct CheckpointRecord {
+  char magic[8];
+  char tx_id[256];
+  char item_id[64];
+  uint64_t start_offset;
+  uint64_t end_offset;
+  uint64_t resume_offset;
+  uint64_t chunk_cnt;
+  int32_t unbundle;
+  int32_t iter_index;
+  int32_t di_cnt_done;
+  int32_t offset_done;
+  int32_t header_done;
+  int32_t partial_len;
+  int64_t item_index;
+  uint64_t item_written;
+  uint32_t data_item_cnt;
+  uint32_t entry_cnt;
+  uint8_t partial[64];
+};
+
+#define CHECKPOINT_MAGIC "ANS104C1"
+
+int CheckpointIsDone(struct Checkpoint *cp, uint64_t pos) {
+  uint64_t k = pos / MAX_CHUNK_SIZE;
+
+  return pos % MAX_CHUNK_SIZE == 0 && k < cp->chunk_cnt && (cp->done[k / 8] >> (k % 8)) & 1;
+}
+
+/**
+ * @brief Start a pass over the bundle with no chunk of it done
+ **/
+void CheckpointNewPass(struct ArweaveBundle *arBundle) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+
+  if (cp == NULL) {
+    return;
+  }
+  memset(cp->done, 0, (cp->chunk_cnt + 7) / 8);
+  cp->run_start = 0;
+  cp->run_end = 0;
+  cp->resume_offset = 0;
+}
+
+/**
+ * @brief Write the checkpoint out
+ *
+ * It goes to a temporary file renamed over the old one, so a run killed
+ * half way through the write still leaves the previous checkpoint behind.
+ * Failing to write it only costs the ability to resume.
+ **/
+void CheckpointSave(struct ArweaveBundle *arBundle,
+                    struct ArweaveBundleHeader *arBundleHeader,
+                    struct StateMachine *state) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+  struct CheckpointRecord rec;
+  char tmp[820];
+  uint32_t n = arBundleHeader->entry_cnt;
+  FILE *f;
+  int ok;
+
+  memset(&rec, 0, sizeof(rec));
+  memcpy(rec.magic, CHECKPOINT_MAGIC, sizeof(rec.magic));
+  strcpy(rec.tx_id, arBundle->tx_id);
+  strcpy(rec.item_id, arBundle->item_id);
+  rec.start_offset = arBundle->startOffset;
+  rec.end_offset = arBundle->endOffset;
+  rec.resume_offset = cp->resume_offset;
+  rec.chunk_cnt = cp->chunk_cnt;
+  rec.unbundle = arBundle->unbundle_dir != NULL;
+  rec.iter_index = state->iter_index;
+  rec.di_cnt_done = state->di_cnt_done;
+  rec.offset_done = state->offset_done;
+  rec.header_done = state->header_done;
+  rec.item_index = state->item_index;
+  rec.item_written = state->item_written;
+  rec.data_item_cnt = arBundleHeader->data_item_cnt;
+  rec.entry_cnt = n;
+  rec.partial_len = arBundleHeader->partial_len;
+  memcpy(rec.partial, arBundleHeader->partial, sizeof(rec.partial));
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", cp->path);
+  if ((f = fopen(tmp, "wb")) == NULL) {
+    perror("checkpoint open");
+    return;
+  }
+  ok = fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+       fwrite(cp->done, 1, (cp->chunk_cnt + 7) / 8, f) == (cp->chunk_cnt + 7) / 8 &&
+       fwrite(arBundleHeader->sizes, sizeof(uint64_t), n, f) == n &&
+       fwrite(arBundleHeader->ids, 32, n, f) == n &&
+       fwrite(arBundleHeader->starts, sizeof(uint64_t), n, f) == n;
+  if (fclose(f) != 0 || !ok) {
+    perror("checkpoint write");
+    unlink(tmp);
+    return;
+  }
+  if (rename(tmp, cp->path) == -1) {
+    perror("checkpoint rename");
+    unlink(tmp);
+    return;
+  }
+  cp->saved_at = MonotonicSeconds();
+}
+
+/**
+ * @brief Record that the chunk parsed last ran from weave offset from up to
+ *        currentOffset
+ *
+ * An aligned chunk counts as done once the bytes parsed back to back cover
+ * all of it, however the node cut the chunks it served.
+ **/
+void CheckpointChunkDone(struct ArweaveBundle *arBundle,
+                         struct ArweaveBundleHeader *arBundleHeader,
+                         struct StateMachine *state,
+                         uint64_t from) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+  uint64_t pos, end;
+
+  if (cp == NULL) {
+    return;
+  }
+  pos = from - arBundle->startOffset;
+  end = arBundle->currentOffset - arBundle->startOffset;
+  if (pos != cp->run_end) {
+    cp->run_start = pos;
+  }
+  cp->run_end = end;
+
+  for (uint64_t k = pos / MAX_CHUNK_SIZE; k < cp->chunk_cnt && k * MAX_CHUNK_SIZE < end; k++) {
+    if (k * MAX_CHUNK_SIZE >= cp->run_start &&
+        ((k + 1) * MAX_CHUNK_SIZE <= end || end >= arBundle->size)) {
+      cp->done[k / 8] |= 1 << (k % 8);
+    }
+  }
+  cp->resume_offset = arBundle->currentOffset;
+
+  if (MonotonicSeconds() - cp->saved_at >= CHECKPOINT_INTERVAL) {
+    CheckpointSave(arBundle, arBundleHeader, state);
+  }
+}
+
+/**
+ * @brief Step over the chunk at currentOffset if an earlier run parsed it
+ *
+ * Done chunks lead up to where the saved parser state picks up. When that
+ * is part way into a chunk, the rest of the chunk is fetched from there.
+ *
+ * @return 1 when currentOffset moved
+ **/
+int CheckpointSkip(struct ArweaveBundle *arBundle) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+  uint64_t pos = arBundle->currentOffset - arBundle->startOffset;
+
+  if (cp == NULL || pos % MAX_CHUNK_SIZE != 0) {
+    return 0;
+  }
+  if (CheckpointIsDone(cp, pos)) {
+    pos += arBundle->size - pos < MAX_CHUNK_SIZE ? arBundle->size - pos : MAX_CHUNK_SIZE;
+    cp->run_start = cp->run_end = pos;
+  } else if (cp->resume_offset > arBundle->currentOffset &&
+             cp->resume_offset - arBundle->currentOffset < MAX_CHUNK_SIZE) {
+    cp->run_start = pos;
+    cp->run_end = pos = cp->resume_offset - arBundle->startOffset;
+  } else {
+    return 0;
+  }
+  arBundle->currentOffset = arBundle->startOffset + pos;
+  return 1;
+}
+
+/**
+ * @brief Reopen the file of the data item being written when the run stopped
+ * @return File descriptor, -1 when it's gone
+ **/
+int CheckpointReopenItem(struct ArweaveBundle *arBundle,
+                         struct ArweaveBundleHeader *arBundleHeader,
+                         int64_t index) {
+  char path[640];
+  char id[44];
+  int fd;
+
+  if (arBundle->unbundle_dir != NULL) {
+    base64urlEncode(arBundleHeader->ids[index], 32, id);
+    snprintf(path, sizeof(path), "%s/%s", arBundle->unbundle_dir, id);
+  } else {
+    snprintf(path, sizeof(path), "%s", arBundle->item_id);
+  }
+  if ((fd = open(path, O_WRONLY)) == -1) {
+    perror(path);
+  }
+  return fd;
+}
+
+/**
+ * @brief Pick up the parser state an earlier run on this bundle left
+ *
+ * The checkpoint has to be of the same bundle and the same --item or
+ * --unbundle, otherwise the bundle starts over.
+ *
+ * @return 1 when resuming, 0 when starting from scratch
+ **/
+int CheckpointLoad(struct ArweaveBundle *arBundle,
+                   struct ArweaveBundleHeader *arBundleHeader,
+                   struct StateMachine *state) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+  struct ArweaveBundleHeader loaded;
+  struct CheckpointRecord rec;
+  uint32_t n;
+  int fd = -1;
+  int ok;
+  FILE *f;
+
+  if ((f = fopen(cp->path, "rb")) == NULL) {
+    if (errno != ENOENT) {
+      perror(cp->path);
+    }
+    return 0;
+  }
+  BundleHeaderInit(&loaded);
+  ok = fread(&rec, sizeof(rec), 1, f) == 1 &&
+       memcmp(rec.magic, CHECKPOINT_MAGIC, sizeof(rec.magic)) == 0 &&
+       strncmp(rec.tx_id, arBundle->tx_id, sizeof(rec.tx_id)) == 0 &&
+       strncmp(rec.item_id, arBundle->item_id, sizeof(rec.item_id)) == 0 &&
+       rec.unbundle == (arBundle->unbundle_dir != NULL) &&
+       rec.start_offset == arBundle->startOffset && rec.end_offset == arBundle->endOffset &&
+       rec.chunk_cnt == cp->chunk_cnt && rec.entry_cnt <= rec.data_item_cnt &&
+       rec.data_item_cnt <= (arBundle->size - 32) / 64 &&
+       rec.partial_len >= 0 && rec.partial_len < (int)sizeof(rec.partial) &&
+       rec.item_index <= (int64_t)rec.entry_cnt;
+
+  if (ok && (n = rec.entry_cnt) > 0) {
+    loaded.sizes = malloc(n * sizeof(uint64_t));
+    loaded.ids = malloc(n * sizeof(loaded.ids[0]));
+    loaded.starts = malloc(n * sizeof(uint64_t));
+    if (loaded.sizes == NULL || loaded.ids == NULL || loaded.starts == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    loaded.entry_cnt = loaded.entry_cap = n;
+  }
+  ok = ok && fread(cp->done, 1, (cp->chunk_cnt + 7) / 8, f) == (cp->chunk_cnt + 7) / 8 &&
+       fread(loaded.sizes, sizeof(uint64_t), loaded.entry_cnt, f) == loaded.entry_cnt &&
+       fread(loaded.ids, 32, loaded.entry_cnt, f) == loaded.entry_cnt &&
+       fread(loaded.starts, sizeof(uint64_t), loaded.entry_cnt, f) == loaded.entry_cnt;
+  fclose(f);
+
+  if (ok && rec.item_index >= 0 && rec.item_index < rec.entry_cnt && rec.item_written > 0 &&
+      (fd = CheckpointReopenItem(arBundle, &loaded, rec.item_index)) == -1) {
+    ok = 0;
+  }
+  if (!ok) {
+    printf("checkpoint %s doesn't fit this run, starting %s over\n", cp->path, arBundle->tx_id);
+    BundleHeaderFree(&loaded);
+    CheckpointNewPass(arBundle);
+    return 0;
+  }
+
+  BundleHeaderFree(arBundleHeader);
+  *arBundleHeader = loaded;
+  arBundleHeader->data_item_cnt = rec.data_item_cnt;
+  arBundleHeader->partial_len = rec.partial_len;
+  memcpy(arBundleHeader->partial, rec.partial, sizeof(rec.partial));
+  state->iter_index = rec.iter_index;
+  state->di_cnt_done = rec.di_cnt_done;
+  state->offset_done = rec.offset_done;
+  state->header_done = rec.header_done;
+  state->item_index = rec.item_index;
+  state->item_written = rec.item_written;
+  state->item_fd = fd;
+  cp->resume_offset = rec.resume_offset;
+  cp->run_start = cp->run_end = 0;
+
+  n = 0;
+  for (uint64_t k = 0; k < cp->chunk_cnt; k++) {
+    n += (cp->done[k / 8] >> (k % 8)) & 1;
+  }
+  printf("resuming %s at offset %" PRIu64 ", %u of %" PRIu64 " chunks done\n", arBundle->tx_id,
+         cp->resume_offset, n, cp->chunk_cnt);
+  return 1;
+}
+
+/**
+ * @brief Set up the checkpoint of the bundle about to be fetched
+ * @return 1 when an earlier run is resumed, 0 otherwise
+ **/
+int CheckpointBegin(struct ArweaveBundle *arBundle,
+                    struct ArweaveBundleHeader *arBundleHeader,
+                    struct StateMachine *state) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+
+  snprintf(cp->path, sizeof(cp->path), "%s/%s.checkpoint", cp->dir, arBundle->tx_id);
+  cp->chunk_cnt = (arBundle->size + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
+  if ((cp->done = calloc((cp->chunk_cnt + 7) / 8, 1)) == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  cp->saved_at = MonotonicSeconds();
+  CheckpointNewPass(arBundle);
+  return CheckpointLoad(arBundle, arBundleHeader, state);
+}
+
+/**
+ * @brief Done with the bundle, drop its checkpoint once it's complete
+ **/
+void CheckpointEnd(struct ArweaveBundle *arBundle, int complete) {
+  struct Checkpoint *cp = arBundle->checkpoint;
+
+  if (complete && unlink(cp->path) == -1 && errno != ENOENT) {
+    perror("checkpoint unlink");
+  }
+  free(cp->done);
+  cp->done = NULL;
+}
+
+/**
+ * On-disk layout of an --index file: this record, then the item ids sorted
+ * bytewise, the entry each sorted id belongs to, and the starts and sizes
+ * of the entries in bundle order. Every column begins 8 byte aligned, so a
+ * mapped file is binary searched where it lies.
+ **/
+struct BundleIndexRecord {
+  char magic[8];
+  char tx_id[256];
+  uint64_t start_offset;
+  uint64_t end_offset;
+  uint64_t size;
+  // bytes of the count and offsets table, where the first item starts
+  uint64_t header_size;
+  uint32_t data_item_cnt;
+  uint32_t flags;
+};
+
+#define INDEX_MAGIC "ANS104X1"
+// start_offset and end_offset are weave offsets, not those of a --file
+#define INDEX_WEAVE_OFFSETS 1
+
+/**
+ * @brief Bytes an index of cnt items takes, with where each column starts
+ **/
+uint64_t IndexLayout(uint64_t cnt, uint64_t *order, uint64_t *starts, uint64_t *sizes) {
+  uint64_t ids = sizeof(struct BundleIndexRecord);
+
+  *order = ids + 32 * cnt;
+  *starts = *order + (4 * cnt + 7) / 8 * 8;
+  *sizes = *starts + 8 * cnt;
+  return *sizes + 8 * cnt;
+}
+
+void IndexPath(const char *dir, const char *txId, char *path, int len) {
+  snprintf(path, len, "%s/%s.index", dir, txId);
+}
+
+static int IndexIdCompare(const void *a, const void *b, void *ids) {
+  const uint8_t (*id)[32] = ids;
+
+  return memcmp(id[*(const uint32_t *)a], id[*(const uint32_t *)b], 32);
+}
+
+/**
+ * @brief Write the index of a bundle whose offsets table is all parsed
+ *
+ * Like the checkpoint it goes to a temporary file renamed over the old
+ * one. Failing to write it only costs the lookups it would have saved.
+ **/
+void IndexWrite(struct ArweaveBundle *arBundle, struct ArweaveBundleHeader *arBundleHeader) {
+  struct BundleIndexRecord rec;
+  uint32_t n = arBundleHeader->entry_cnt;
+  uint64_t orderAt, startsAt, sizesAt;
+  uint32_t *order;
+  char path[800], tmp[820];
+  FILE *f;
+  int ok;
+
+  if ((order = malloc((n + 1) * sizeof(uint32_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  qsort_r(order, n, sizeof(uint32_t), IndexIdCompare, arBundleHeader->ids);
+
+  memset(&rec, 0, sizeof(rec));
+  memcpy(rec.magic, INDEX_MAGIC, sizeof(rec.magic));
+  strcpy(rec.tx_id, arBundle->tx_id);
+  rec.start_offset = arBundle->startOffset;
+  rec.end_offset = arBundle->endOffset;
+  rec.size = arBundle->size;
+  rec.header_size = 32 + 64 * (uint64_t)n;
+  rec.data_item_cnt = n;
+  rec.flags = arBundle->local == NULL ? INDEX_WEAVE_OFFSETS : 0;
+  IndexLayout(n, &orderAt, &startsAt, &sizesAt);
+
+  IndexPath(arBundle->index_dir, arBundle->tx_id, path, sizeof(path));
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if ((f = fopen(tmp, "wb")) == NULL) {
+    perror("index open");
+    free(order);
+    return;
+  }
+  ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+  for (uint32_t k = 0; ok && k < n; k++) {
+    ok = fwrite(arBundleHeader->ids[order[k]], 32, 1, f) == 1;
+  }
+  // the padding up to the starts column is the one extra order slot
+  order[n] = 0;
+  ok = ok && fwrite(order, 1, startsAt - orderAt, f) == startsAt - orderAt &&
+       fwrite(arBundleHeader->starts, sizeof(uint64_t), n, f) == n &&
+       fwrite(arBundleHeader->sizes, sizeof(uint64_t), n, f) == n;
+  free(order);
+  if (fclose(f) != 0 || !ok) {
+    perror("index write");
+    unlink(tmp);
+    return;
+  }
+  if (rename(tmp, path) == -1) {
+    perror("index rename");
+    unlink(tmp);
+    return;
+  }
+  printf("indexed %u data items of %s in %s\n", n, arBundle->tx_id, path);
+}
+
+/**
+ * @brief Map the index of a bundle, if an earlier run left one
+ * @return 0 on success, -1 when there is none or it doesn't check out
+ **/
+int IndexOpen(struct BundleIndex *idx, const char *dir, const char *txId) {
+  const struct BundleIndexRecord *rec;
+  uint64_t orderAt, startsAt, sizesAt;
+  char path[800];
+  struct stat st;
+  int fd;
+
+  IndexPath(dir, txId, path, sizeof(path));
+  if ((fd = open(path, O_RDONLY)) == -1) {
+    if (errno != ENOENT) {
+      perror(path);
+    }
+    return -1;
+  }
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct BundleIndexRecord)) {
+    fprintf(stderr, "index %s is cut short, ignoring it\n", path);
+    close(fd);
+    return -1;
+  }
+  idx->len = st.st_size;
+  idx->map = mmap(NULL, idx->len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (idx->map == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+
+  rec = idx->rec = idx->map;
+  if (memcmp(rec->magic, INDEX_MAGIC, sizeof(rec->magic)) != 0 ||
+      strncmp(rec->tx_id, txId, sizeof(rec->tx_id)) != 0 ||
+      IndexLayout(rec->data_item_cnt, &orderAt, &startsAt, &sizesAt) != idx->len ||
+      rec->size != rec->end_offset - rec->start_offset + 1 ||
+      rec->header_size != 32 + 64 * (uint64_t)rec->data_item_cnt) {
+    fprintf(stderr, "index %s doesn't check out, ignoring it\n", path);
+    munmap(idx->map, idx->len);
+    return -1;
+  }
+  idx->ids = (const uint8_t(*)[32])((const char *)idx->map + sizeof(*rec));
+  idx->order = (const uint32_t *)((const char *)idx->map + orderAt);
+  idx->starts = (const uint64_t *)((const char *)idx->map + startsAt);
+  idx->sizes = (const uint64_t *)((const char *)idx->map + sizesAt);
+  return 0;
+}
+
+void IndexClose(struct BundleIndex *idx) {
+  munmap(idx->map, idx->len);
+}
+
+/**
+ * @brief Binary search the sorted id column
+ * @return Entry index in bundle order, -1 if the bundle doesn't hold the id
+ **/
+int64_t IndexFind(const struct BundleIndex *idx, const uint8_t *id) {
+  uint32_t lo = 0, hi = idx->rec->data_item_cnt;
+  uint32_t mid;
+  int cmp;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if ((cmp = memcmp(idx->ids[mid], id, 32)) == 0) {
+      return idx->order[mid] < idx->rec->data_item_cnt ? (int64_t)idx->order[mid] : -1;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Take the size and offsets of the bundle from its index
+ * @return 1 on success, 0 when the index was made from a --file
+ **/
+int IndexOffsets(const struct BundleIndex *idx, struct ArweaveBundle *arBundle) {
+  if (!(idx->rec->flags & INDEX_WEAVE_OFFSETS)) {
+    return 0;
+  }
+  arBundle->startOffset = idx->rec->start_offset;
+  arBundle->endOffset = idx->rec->end_offset;
+  arBundle->size = idx->rec->size;
+  arBundle->currentOffset = arBundle->startOffset;
+  printf("size: %" PRIu64 " offset: %" PRIu64 " from the index\n", arBundle->size,
+         arBundle->endOffset);
+  return 1;
+}
+
+/**
+ * @brief Stand the index entries of the --item, or of the --extract items,
+ *        in for the bundle header
+ *
+ * The header gets those entries only, so ExtractItem or the --extract runs
+ * go straight on with fetching the items' own chunks.
+ **/
+void IndexLoadItem(struct ArweaveBundle *arBundle,
+                   struct ArweaveBundleHeader *arBundleHeader,
+                   struct StateMachine *state) {
+  const struct BundleIndex *idx = arBundle->index;
+  struct ExtractPlan *plan = arBundle->plan;
+  struct ExtractId one;
+  struct ExtractId *want = &one;
+  uint32_t cnt = 1, n = 0;
+  char raw[48];
+  int rawLen;
+  int64_t i = -1;
+  double started = MonotonicSeconds();
+
+  if (idx->rec->size != arBundle->size) {
+    printf("index of %s is of a bundle of another size, ignoring it\n", arBundle->tx_id);
+    return;
+  }
+  if (plan != NULL) {
+    want = plan->wanted;
+    cnt = plan->cnt;
+  } else if (base64urlDecode(arBundle->item_id, strlen(arBundle->item_id), raw, &rawLen) &&
+             rawLen == 32) {
+    strcpy(one.id, arBundle->item_id);
+    memcpy(one.raw, raw, 32);
+  } else {
+    fprintf(stderr, "bundle %s holds no item %s\n", arBundle->tx_id, arBundle->item_id);
+    exit(EXIT_FAILURE);
+  }
+
+  BundleHeaderFree(arBundleHeader);
+  arBundleHeader->sizes = malloc(cnt * sizeof(uint64_t));
+  arBundleHeader->ids = malloc(cnt * sizeof(arBundleHeader->ids[0]));
+  arBundleHeader->starts = malloc(cnt * sizeof(uint64_t));
+  if (arBundleHeader->sizes == NULL || arBundleHeader->ids == NULL ||
+      arBundleHeader->starts == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (uint32_t k = 0; k < cnt; k++) {
+    // the --extract items it doesn't find are reported once the runs are laid out
+    if ((i = IndexFind(idx, want[k].raw)) == -1 && plan != NULL) {
+      continue;
+    }
+    if (i == -1) {
+      fprintf(stderr, "bundle %s holds no item %s\n", arBundle->tx_id, want[k].id);
+      exit(EXIT_FAILURE);
+    }
+    if (idx->sizes[i] > arBundle->size || idx->starts[i] > arBundle->size - idx->sizes[i]) {
+      fprintf(stderr, "item %" PRId64 " runs past the end of bundle %s\n", i, arBundle->tx_id);
+      exit(EXIT_FAILURE);
+    }
+    arBundleHeader->sizes[n] = idx->sizes[i];
+    arBundleHeader->starts[n] = idx->starts[i];
+    memcpy(arBundleHeader->ids[n], want[k].raw, 32);
+    n++;
+  }
+  arBundleHeader->data_item_cnt = idx->rec->data_item_cnt;
+  arBundleHeader->entry_cnt = n;
+  arBundleHeader->entry_cap = cnt;
+  state->iter_index = arBundleHeader->data_item_cnt;
+  state->di_cnt_done = 1;
+  state->offset_done = 1;
+  state->header_done = 1;
+  if (plan != NULL) {
+    printf("index: %u of %u items, looked up in %.1f us\n", n, cnt,
+           (MonotonicSeconds() - started) * 1e6);
+  } else {
+    printf("index: item %" PRId64 " of %u, looked up in %.1f us\n", i,
+           arBundleHeader->data_item_cnt, (MonotonicSeconds() - started) * 1e6);
+  }
+}
+
+struct CacheEntry {
+  time_t mtime;
+  uint64_t size;
+  char name[64];
+};
+
+static int CacheEntryCompare(const void *a, const void *b) {
+  const struct CacheEntry *x = a;
+  const struct CacheEntry *y = b;
+
+  return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/**
+ * @brief Recount the cache directory and evict the oldest chunks until it
+ *        holds target bytes at most
+ *
+ * Other runs may share the directory, so the size comes from disk rather
+ * than from our own bookkeeping.
+ **/
+void CacheTrim(struct ChunkCache *cache, uint64_t target) {
+  struct CacheEntry *entries = NULL;
+  int cnt = 0, cap = 0;
+  struct dirent *de;
+  struct stat st;
+  char path[640];
+  DIR *dir;
+
+  if ((dir = opendir(cache->dir)) == NULL) {
+    perror("opendir");
+    return;
+  }
+  cache->used = 0;
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.' || strlen(de->d_name) >= sizeof(entries[0].name) ||
+        strstr(de->d_name, ".chunk") == NULL) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", cache->dir, de->d_name);
+    if (stat(path, &st) == -1) {
+      continue;
+    }
+    if (cnt == cap) {
+      cap = cap ? cap * 2 : 1024;
+      if ((entries = realloc(entries, cap * sizeof(struct CacheEntry))) == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    entries[cnt].mtime = st.st_mtime;
+    entries[cnt].size = st.st_size;
+    strcpy(entries[cnt].name, de->d_name);
+    cache->used += st.st_size;
+    cnt++;
+  }
+  closedir(dir);
+
+  if (cache->used > target) {
+    qsort(entries, cnt, sizeof(struct CacheEntry), CacheEntryCompare);
+    for (int i = 0; i < cnt && cache->used > target; i++) {
+      snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+      if (unlink(path) == 0) {
+        cache->used -= entries[i].size;
+        cache->evictions++;
+      }
+    }
+  }
+  free(entries);
+}
+
+void CacheInit(struct ChunkCache *cache, const char *dir, uint64_t cap) {
+  memset(cache, 0, sizeof(*cache));
+  strncpy(cache->dir, dir, sizeof(cache->dir) - 1);
+  cache->cap = cap;
+  if (mkdir(cache->dir, 0755) == -1 && errno != EEXIST) {
+    perror("mkdir");
+    exit(1);
+  }
+  CacheTrim(cache, cache->cap);
+}
+
+void CacheReport(struct ChunkCache *cache) {
+  printf("cache hits: %" PRIu64 " (%" PRIu64 " bytes) misses: %" PRIu64
+         " evictions: %" PRIu64 " size: %" PRIu64 " of %" PRIu64 " bytes\n",
+         cache->hits, cache->hit_bytes, cache->misses, cache->evictions, cache->used,
+         cache->cap);
+}
+
+void CachePath(struct ChunkCache *cache, uint64_t offset, char *path, int len) {
+  snprintf(path, len, "%s/%" PRIu64 ".chunk", cache->dir, offset);
+}
+
+int CacheHas(struct ChunkCache *cache, uint64_t offset) {
+  char path[640];
+
+  CachePath(cache, offset, path, sizeof(path));
+  return access(path, R_OK) == 0;
+}
+
+/**
+ * @brief Store a chunk fetched from a node
+ *
+ * The chunk goes to a file private to this process first and is renamed
+ * into place, so a run sharing the directory sees the whole chunk or
+ * nothing. Failing to write the cache only costs the speedup.
+ **/
+void CacheStore(struct ChunkCache *cache, uint64_t offset, const char *chunk, int chunkLen) {
+  char path[640];
+  char tmp[700];
+  int fd, written;
+
+  CachePath(cache, offset, path, sizeof(path));
+  snprintf(tmp, sizeof(tmp), "%s/.%" PRIu64 ".%d.tmp", cache->dir, offset, (int)getpid());
+
+  if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+    perror("cache open");
+    return;
+  }
+  for (int n = 0; n < chunkLen; n += written) {
+    if ((written = write(fd, chunk + n, chunkLen - n)) == -1) {
+      perror("cache write");
+      close(fd);
+      unlink(tmp);
+      return;
+    }
+  }
+  close(fd);
+  if (rename(tmp, path) == -1) {
+    perror("cache rename");
+    unlink(tmp);
+    return;
+  }
+
+  cache->used += chunkLen;
+  if (cache->used > cache->cap) {
+    // trim below the cap so the next stores don't rescan right away
+    CacheTrim(cache, cache->cap / 10 * 9);
+  }
+}
+
+/**
+ * @brief Parse the chunk at currentOffset straight out of the cache
+ * @return 1 on a hit, 0 if the chunk has to come from a node
+ **/
+int CacheConsume(struct ArweaveNode *arNode,
+                 struct ArweaveBundle *arBundle,
+                 struct ArweaveBundleHeader *arBundleHeader,
+                 struct StateMachine *state) {
+  struct ChunkCache *cache = arBundle->cache;
+  char path[640];
+  struct stat st;
+  char *chunk;
+  int fd;
+
+  CachePath(cache, arBundle->currentOffset, path, sizeof(path));
+  if ((fd = open(path, O_RDONLY)) == -1) {
+    return 0;
+  }
+  if (fstat(fd, &st) == -1 || st.st_size == 0 || st.st_size > MAX_CHUNK_SIZE) {
+    close(fd);
+    return 0;
+  }
+  chunk = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (chunk == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  // eviction goes by mtime, so a hit makes the chunk recent again
+  futimens(fd, NULL);
+  close(fd);
+
+  ProcessChunk(arNode, arBundle, arBundleHeader, state, st.st_size, chunk);
+  munmap(chunk, st.st_size);
+
+  arBundle->currentOffset += st.st_size;
+  CheckpointChunkDone(arBundle, arBundleHeader, state, arBundle->currentOffset - st.st_size);
+  StatsChunk(st.st_size);
+  FetchJump(arBundle);
+  if (arBundle->verifier != NULL) {
+    VerifierUnchecked(arBundle->verifier);
+  }
+  cache->hits++;
+  cache->hit_bytes += st.st_size;
+  return 1;
+}
+
+/**
+ * @brief Feed one decoded chunk to the parser and advance the bundle cursor
+ * @return Number of bundle bytes the chunk carried
+ **/
+int ConsumeChunk(struct ArweaveNode *arNode,
+                 struct ArweaveBundle *arBundle,
+                 struct ArweaveBundleHeader *arBundleHeader,
+                 struct StateMachine *state,
+                 int chunkLen,
+                 const char *chunk) {
+  if (arBundle->cache != NULL && chunkLen > 0) {
+    CacheStore(arBundle->cache, arBundle->currentOffset, chunk, chunkLen);
+    arBundle->cache->misses++;
+  }
+
+  int decodedSize = ProcessChunk(arNode, arBundle, arBundleHeader, state,
+                                 chunkLen, chunk);
+  if (decodedSize <= 0) {
+    fprintf(stderr, "chunk offset %" PRId64 " is empty\n", arBundle->currentOffset);
+    exit(EXIT_FAILURE);
+  }
+  arBundle->currentOffset += decodedSize;
+  CheckpointChunkDone(arBundle, arBundleHeader, state, arBundle->currentOffset - decodedSize);
+  StatsChunk(decodedSize);
+  FetchJump(arBundle);
+  return decodedSize;
+}
+
+/**
+ * @brief Fetch and parse chunks one connection at a time
+ *
+ * A chunk that can't be had is asked for again on a fresh connection after
+ * a backoff, MAX_FETCH_ATTEMPTS times in all.
+ *
+ * @return 0 on success, -1 when a chunk couldn't be fetched
+ **/
+int ProcessBundleSequential(struct ArweaveNode *arNode,
+                            struct ArweaveBundle *arBundle,
+                            struct ArweaveBundleHeader *arBundleHeader,
+                            struct StateMachine *state) {
+
+  int status, keepAlive;
+  int attempts = 0;
+
+  struct ArweaveConnection conn;
+  char *chunk_buffer;
+  int chunkLen;
+
+  // offsets of the requests written to conn and not read back yet,
+  // assuming every chunk but the last one is MAX_CHUNK_SIZE long
+  uint64_t pipeline[PIPELINE_DEPTH];
+  int pipeline_head = 0;
+  int pipeline_cnt = 0;
+  uint64_t nextRequestOffset = arBundle->currentOffset;
+
+  conn = PoolAcquire(arNode);
+  chunk_buffer = ChunkPoolAcquire(&chunkPool);
+
+  while (arBundle->currentOffset <= FetchLimit(arBundle)) {
+
+    while (pipeline_cnt < PIPELINE_DEPTH && nextRequestOffset <= FetchLimit(arBundle)) {
+      if (SendChunkRequest(arNode, &conn, arBundle, nextRequestOffset) == -1) {
+        break;
+      }
+      pipeline[(pipeline_head + pipeline_cnt) % PIPELINE_DEPTH] = nextRequestOffset;
+      pipeline_cnt++;
+      // the chunks between --extract runs aren't asked for
+      nextRequestOffset = FetchNextWanted(arBundle, nextRequestOffset + MAX_CHUNK_SIZE);
+    }
+
+    if (pipeline_cnt == 0) {
+      status = 0;
+    } else if (arBundle->raw) {
+      status = ReadRawResponse(arNode, &conn, arBundle->currentOffset, chunk_buffer, &chunkLen,
+                               &keepAlive);
+    } else {
+      status = ReadChunkResponse(arNode, &conn, arBundle->currentOffset, chunk_buffer, &chunkLen,
+                                 &keepAlive, arBundle->verifier);
+    }
+    if (status <= 0) {
+      // a kept-alive connection the node hung up on is replayed for free,
+      // anything else counts as a failed attempt at the chunk
+      if (status == -1 || !conn.reused) {
+        if (++attempts == MAX_FETCH_ATTEMPTS) {
+          fprintf(stderr, "giving up on chunk offset %" PRIu64 " of %s\n",
+                  arBundle->currentOffset, arNode->domain);
+          PoolRelease(arNode, &conn, 0);
+          ChunkPoolRelease(&chunkPool, chunk_buffer);
+          return -1;
+        }
+        RetryWait(attempts);
+      }
+      PoolRelease(arNode, &conn, 0);
+      conn = PoolAcquire(arNode);
+      pipeline_cnt = 0;
+      nextRequestOffset = arBundle->currentOffset;
+      continue;
+    }
+    attempts = 0;
+    pipeline_head = (pipeline_head + 1) % PIPELINE_DEPTH;
+    pipeline_cnt--;
+
+    ConsumeChunk(arNode, arBundle, arBundleHeader, state, chunkLen, chunk_buffer);
+
+    // --filter jumped ahead, read past the responses for the chunks skipped
+    while (keepAlive && pipeline_cnt > 0 &&
+           pipeline[pipeline_head] + MAX_CHUNK_SIZE <= arBundle->currentOffset) {
+      keepAlive = DrainPipeline(arNode, &conn, 1);
+      pipeline_head = (pipeline_head + 1) % PIPELINE_DEPTH;
+      pipeline_cnt--;
+    }
+    if (nextRequestOffset < arBundle->currentOffset) {
+      nextRequestOffset = arBundle->currentOffset;
+    }
+
+    if (!keepAlive) {
+      PoolRelease(arNode, &conn, 0);
+      conn = PoolAcquire(arNode);
+      pipeline_cnt = 0;
+      nextRequestOffset = arBundle->currentOffset;
+    } else if (pipeline_cnt > 0 && pipeline[pipeline_head] != arBundle->currentOffset) {
+      // a short chunk, everything written ahead asked for the wrong offsets
+      if (!DrainPipeline(arNode, &conn, pipeline_cnt)) {
+        PoolRelease(arNode, &conn, 0);
+        conn = PoolAcquire(arNode);
+      }
+      pipeline_cnt = 0;
+      nextRequestOffset = arBundle->currentOffset;
+    }
+  }
+
+  PoolRelease(arNode, &conn, pipeline_cnt == 0);
+  ChunkPoolRelease(&chunkPool, chunk_buffer);
+
+  return 0;
+
+}
+
+struct ChunkSlot {
+  char *data;
+  int len;
+  int ready;
+  // when the item was first asked for, and whether a second node was asked too
+  double requested_at;
+  int hedged;
+  // failed attempts at the item, and when to ask again, 0 if no retry is due
+  int attempts;
+  double retry_at;
+  struct ArweaveNode *failed_on;
+};
+
+// Where an engine connection is in its request/response cycle
+enum EngineConnState {
+  ENGINE_CONN_CLOSED,
+  ENGINE_CONN_CONNECTING,
+  ENGINE_CONN_IDLE,
+  ENGINE_CONN_READING
+};
+
+struct EngineRequest {
+  uint64_t item;
+  double sent_at;
+  // a second ask for an item some other node is late with
+  int hedge;
+};
+
+struct EngineConnection {
+  struct ArweaveNode *arNode;
+  int sock;
+  int state;
+  int reused;
+  int served;
+  // requests pipelined here, in the order their responses come back
+  struct EngineRequest queue[PIPELINE_DEPTH];
+  int queue_head;
+  int queue_cnt;
+  char out[PIPELINE_DEPTH * 512];
+  int out_len;
+  int out_sent;
+  struct HttpReader rd;
+  struct HttpResponse res;
+  struct ChunkFieldSink sink;
+  // buffer the response being read lands in, the item's slot or scratch
+  char *target;
+  // when the non-blocking connect was started
+  double connect_started;
+  // for responses nobody waits for any more, and for hedges
+  char *scratch;
+  // --verify, the data_path of the response being read
+  char *path;
+};
+
+/**
+ * Single threaded, non-blocking fetch engine behind --jobs.
+ * Work item i is the chunk holding weave offset startOffset + i * MAX_CHUNK_SIZE;
+ * its response lands in slots[i % window] and the parser takes the slots
+ * back in item order, so connections never run more than window items ahead.
+ * Each item goes to the connection expected to answer it first, and the item
+ * the parser waits on is asked of a second node once it runs past the p95
+ * latency of the first. Failed items are asked again after a backoff,
+ * preferably of another node, and nodes that keep failing sit out a while.
+ **/
+struct ChunkEngine {
+  int epfd;
+  struct ArweaveBundle *arBundle;
+  uint64_t startOffset;
+  uint64_t item_cnt;
+  uint64_t next_item;
+  uint64_t parse_item;
+  int window;
+  struct ChunkSlot *slots;
+  struct EngineConnection *conns;
+  int conn_cnt;
+  int node_cnt;
+  // items waiting for their retry_at
+  int retry_cnt;
+  // an item ran out of attempts
+  int failed;
+};
+
+void EngineWatch(struct ChunkEngine *engine, struct EngineConnection *conn,
+                 uint32_t events, int op) {
+  struct epoll_event ev;
+
+  ev.events = events;
+  ev.data.ptr = conn;
+  if (epoll_ctl(engine->epfd, op, conn->sock, &ev) == -1) {
+    perror("epoll_ctl");
+    exit(1);
+  }
+}
+
+void EngineClose(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  if (conn->sock >= 0) {
+    epoll_ctl(engine->epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+    close(conn->sock);
+    HttpReaderFree(&conn->rd);
+  }
+  conn->sock = -1;
+  conn->state = ENGINE_CONN_CLOSED;
+  conn->target = NULL;
+}
+
+/**
+ * @brief Count a failure against a node, keeping it out of EnginePick for
+ *        a backoff that grows with every failure in a row
+ **/
+void EngineNodeFailed(struct ArweaveNode *arNode) {
+  arNode->stats.failures++;
+  arNode->stats.down_until = MonotonicSeconds() + RetryDelay(arNode->stats.failures);
+}
+
+/**
+ * @brief A request for an item came to nothing, schedule the next attempt
+ *
+ * Hedges and items that came in some other way are just dropped.
+ **/
+void EngineRequestFailed(struct ChunkEngine *engine, struct EngineConnection *conn,
+                         struct EngineRequest *req) {
+  struct ChunkSlot *slot = &engine->slots[req->item % engine->window];
+
+  if (req->hedge || req->item < engine->parse_item || req->item >= engine->next_item ||
+      slot->ready || slot->retry_at > 0) {
+    return;
+  }
+  if (++slot->attempts == MAX_FETCH_ATTEMPTS) {
+    fprintf(stderr, "giving up on chunk offset %" PRIu64 " after %d attempts\n",
+            engine->startOffset + req->item * MAX_CHUNK_SIZE, slot->attempts);
+    engine->failed = 1;
+    return;
+  }
+  slot->retry_at = MonotonicSeconds() + RetryDelay(slot->attempts);
+  slot->failed_on = conn->arNode;
+  engine->retry_cnt++;
+}
+
+/**
+ * @brief The connection to the node is lost, with every request queued on it
+ **/
+void EngineConnFailed(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  fprintf(stderr, "lost connection to %s:%d\n", conn->arNode->domain, conn->arNode->port);
+  for (int k = 0; k < conn->queue_cnt; k++) {
+    EngineRequestFailed(engine, conn, &conn->queue[(conn->queue_head + k) % PIPELINE_DEPTH]);
+  }
+  conn->queue_cnt = 0;
+  EngineClose(engine, conn);
+  EngineNodeFailed(conn->arNode);
+}
+
+void EngineConnect(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  struct sockaddr_in server_addr;
+
+  conn->served = 0;
+  conn->sock = PoolTakeIdle(conn->arNode);
+  conn->reused = conn->sock >= 0;
+  HttpReaderInit(&conn->rd);
+
+  if (conn->reused) {
+    fcntl(conn->sock, F_SETFL, fcntl(conn->sock, F_GETFL) | O_NONBLOCK);
+    conn->state = ENGINE_CONN_IDLE;
+    EngineWatch(engine, conn, EPOLLIN, EPOLL_CTL_ADD);
+    return;
+  }
+
+  if ((conn->sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1) {
+    perror("Socket");
+    HttpReaderFree(&conn->rd);
+    EngineConnFailed(engine, conn);
+    return;
+  }
+  NodeAddress(conn->arNode, &server_addr);
+  EngineWatch(engine, conn, EPOLLOUT, EPOLL_CTL_ADD);
+  conn->state = ENGINE_CONN_CONNECTING;
+  conn->connect_started = MonotonicSeconds();
+
+  if (connect(conn->sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1 &&
+      errno != EINPROGRESS) {
+    perror("Connect");
+    EngineConnFailed(engine, conn);
+    return;
+  }
+  PoolConnectionOpened(conn->arNode);
+}
+
+char *EngineBuffer(char **buf) {
+  if (*buf == NULL) {
+    *buf = ChunkPoolAcquire(&chunkPool);
+  }
+  return *buf;
+}
+
+/**
+ * @brief Point the connection's parser at where its next response goes
+ *
+ * A response lands in its item's slot unless it is a hedge or the item
+ * came in some other way already, in which case it goes to scratch.
+ **/
+void EngineExpect(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  struct EngineRequest *req = &conn->queue[conn->queue_head];
+  struct ChunkSlot *slot = &engine->slots[req->item % engine->window];
+
+  if (req->hedge || req->item < engine->parse_item || slot->ready) {
+    conn->target = EngineBuffer(&conn->scratch);
+  } else {
+    conn->target = EngineBuffer(&slot->data);
+  }
+  if (engine->arBundle->raw) {
+    HttpResponseInit(&conn->res, NULL, NULL);
+    HttpResponseDirect(&conn->res, conn->target, MAX_CHUNK_SIZE);
+    return;
+  }
+  ChunkFieldSinkInit(&conn->sink, conn->target, MAX_CHUNK_SIZE);
+  if (engine->arBundle->verifier != NULL) {
+    if (conn->path == NULL && (conn->path = malloc(DATA_PATH_MAX_SIZE)) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    conn->sink.path = conn->path;
+  }
+  HttpResponseInit(&conn->res, ChunkFieldSinkWrite, &conn->sink);
+}
+
+void EngineAppendRequest(struct ChunkEngine *engine, struct EngineConnection *conn,
+                         uint64_t item) {
+  if (conn->out_sent == conn->out_len) {
+    conn->out_len = conn->out_sent = 0;
+  } else if (conn->out_sent > 0) {
+    memmove(conn->out, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+    conn->out_len -= conn->out_sent;
+    conn->out_sent = 0;
+  }
+  conn->out_len += FormatChunkRequest(conn->arNode, engine->arBundle,
+                                      engine->startOffset + item * MAX_CHUNK_SIZE,
+                                      conn->out + conn->out_len,
+                                      sizeof(conn->out) - conn->out_len);
+}
+
+/**
+ * @brief Write out everything queued on a connection that just came up
+ **/
+void EngineSendQueue(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  conn->out_len = 0;
+  conn->out_sent = 0;
+  for (int k = 0; k < conn->queue_cnt; k++) {
+    EngineAppendRequest(engine, conn, conn->queue[(conn->queue_head + k) % PIPELINE_DEPTH].item);
+  }
+  EngineExpect(engine, conn);
+  conn->state = ENGINE_CONN_READING;
+  EngineWatch(engine, conn, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+}
+
+/**
+ * @brief Queue a request for an item on a connection, opening it if need be
+ **/
+void EngineQueueRequest(struct ChunkEngine *engine, struct EngineConnection *conn,
+                        uint64_t item, int hedge) {
+  struct EngineRequest *req =
+    &conn->queue[(conn->queue_head + conn->queue_cnt) % PIPELINE_DEPTH];
+
+  req->item = item;
+  req->sent_at = MonotonicSeconds();
+  req->hedge = hedge;
+  conn->queue_cnt++;
+  conn->arNode->stats.last_used = req->sent_at;
+
+  if (conn->state == ENGINE_CONN_CLOSED) {
+    EngineConnect(engine, conn);
+  }
+  if (conn->state == ENGINE_CONN_IDLE) {
+    EngineSendQueue(engine, conn);
+  } else if (conn->state == ENGINE_CONN_READING) {
+    EngineAppendRequest(engine, conn, item);
+    EngineWatch(engine, conn, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+  }
+  // a connection still connecting writes out its queue once it is up
+}
+
+/**
+ * @brief Reopen a connection and write its queued requests again
+ **/
+void EngineRestart(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  EngineClose(engine, conn);
+  if (conn->queue_cnt > 0) {
+    EngineConnect(engine, conn);
+    if (conn->state == ENGINE_CONN_IDLE) {
+      EngineSendQueue(engine, conn);
+    }
+  }
+}
+
+/**
+ * @brief Pick the connection expected to answer a new request first
+ *
+ * That is the one with the fewest requests ahead of it, weighted by the
+ * latency of its node. Nodes far slower than the fastest one are left out,
+ * short of a request every NODE_PROBE_INTERVAL to keep their numbers fresh,
+ * and so are nodes sitting out the backoff of a failure.
+ *
+ * @param[in] exclude Node the item was already asked of, NULL if none
+ * @param[in] hedge Slow nodes are fair game too; a hedge goes wherever it's
+ *            expected back first, behind whatever is queued there already
+ * @return NULL when every eligible connection has a full pipeline
+ **/
+struct EngineConnection *EnginePick(struct ChunkEngine *engine, struct ArweaveNode *exclude,
+                                    int hedge) {
+  struct EngineConnection *best = NULL;
+  struct EngineConnection *conn;
+  struct NodeStats *stats;
+  double now = MonotonicSeconds();
+  double fastest = 0, score, bestScore = 0;
+
+  for (int i = 0; i < engine->conn_cnt; i++) {
+    stats = &engine->conns[i].arNode->stats;
+    if (stats->samples > 0 && (fastest == 0 || stats->latency < fastest)) {
+      fastest = stats->latency;
+    }
+  }
+
+  for (int i = 0; i < engine->conn_cnt; i++) {
+    conn = &engine->conns[i];
+    stats = &conn->arNode->stats;
+    if (conn->queue_cnt == PIPELINE_DEPTH || conn->arNode == exclude ||
+        stats->down_until > now) {
+      continue;
+    }
+    if (!hedge && stats->samples > 0 && stats->latency > SLOW_NODE_FACTOR * fastest &&
+        now - stats->last_used < NODE_PROBE_INTERVAL) {
+      continue;
+    }
+    // a node without samples yet scores 0 so it gets tried
+    score = (conn->queue_cnt + 1) * (stats->samples > 0 ? stats->latency : 0);
+    // a hedge that isn't expected back before the first request is no use
+    if (hedge && exclude->stats.samples > 0 && score >= exclude->stats.latency) {
+      continue;
+    }
+    if (best == NULL || score < bestScore ||
+        (score == bestScore && conn->queue_cnt < best->queue_cnt)) {
+      best = conn;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Ask again for the items whose retry is due
+ **/
+void EngineRetry(struct ChunkEngine *engine) {
+  struct EngineConnection *conn;
+  struct ChunkSlot *slot;
+  double now = MonotonicSeconds();
+
+  for (uint64_t item = engine->parse_item; engine->retry_cnt > 0 && item < engine->next_item;
+       item++) {
+    slot = &engine->slots[item % engine->window];
+    if (slot->retry_at == 0 || slot->retry_at > now) {
+      continue;
+    }
+    if (slot->ready) {
+      // a hedge brought it in meanwhile
+      slot->retry_at = 0;
+      engine->retry_cnt--;
+      continue;
+    }
+    // another node is more likely to have it, but any will do
+    if ((conn = EnginePick(engine, slot->failed_on, 0)) == NULL &&
+        (conn = EnginePick(engine, NULL, 0)) == NULL) {
+      return;
+    }
+    fprintf(stderr, "retrying chunk %" PRIu64 " on %s:%d, attempt %d of %d\n", item,
+            conn->arNode->domain, conn->arNode->port, slot->attempts + 1, MAX_FETCH_ATTEMPTS);
+    runStats.retries++;
+    slot->requested_at = now;
+    slot->hedged = 0;
+    slot->retry_at = 0;
+    engine->retry_cnt--;
+    EngineQueueRequest(engine, conn, item, 0);
+  }
+}
+
+/**
+ * @brief Hand out work items while the window has room
+ **/
+void EngineDispatch(struct ChunkEngine *engine) {
+  struct EngineConnection *conn;
+  struct ChunkSlot *slot;
+  uint64_t item;
+
+  EngineRetry(engine);
+  // items between --extract runs are passed over, the parser jumps them too
+  while ((item = (FetchNextWanted(engine->arBundle,
+                                  engine->startOffset + engine->next_item * MAX_CHUNK_SIZE) -
+                  engine->startOffset) / MAX_CHUNK_SIZE) < engine->item_cnt &&
+         item < engine->parse_item + engine->window) {
+    if ((conn = EnginePick(engine, NULL, 0)) == NULL) {
+      return;
+    }
+    engine->next_item = item;
+    slot = &engine->slots[engine->next_item % engine->window];
+    slot->ready = 0;
+    slot->hedged = 0;
+    slot->attempts = 0;
+    slot->retry_at = 0;
+    slot->requested_at = MonotonicSeconds();
+    EngineQueueRequest(engine, conn, engine->next_item++, 0);
+  }
+}
+
+/**
+ * @brief Move the parser up to item, past the chunks the fetch jumped over
+ *
+ * Responses still owed for the items skipped land in scratch buffers and
+ * are dropped, like those of hedges that lost.
+ **/
+void EngineSkip(struct ChunkEngine *engine, uint64_t item) {
+  struct EngineConnection *conn;
+  struct ChunkSlot *slot;
+  char *buffer;
+
+  for (uint64_t i = engine->parse_item; i < item && i < engine->next_item; i++) {
+    slot = &engine->slots[i % engine->window];
+    for (int k = 0; slot->data != NULL && k < engine->conn_cnt; k++) {
+      conn = &engine->conns[k];
+      if (conn->state == ENGINE_CONN_READING && conn->target == slot->data) {
+        // the slot is about to be reused, the read goes on into scratch
+        buffer = slot->data;
+        slot->data = conn->scratch;
+        conn->scratch = buffer;
+      }
+    }
+    slot->ready = 0;
+    if (slot->retry_at > 0) {
+      slot->retry_at = 0;
+      engine->retry_cnt--;
+    }
+  }
+  engine->parse_item = item;
+  if (engine->next_item < item) {
+    engine->next_item = item;
+  }
+}
+
+/**
+ * @brief Find the connection owing the first request for an item
+ **/
+struct EngineConnection *EngineFindPrimary(struct ChunkEngine *engine, uint64_t item) {
+  struct EngineConnection *conn;
+  struct EngineRequest *req;
+
+  for (int i = 0; i < engine->conn_cnt; i++) {
+    conn = &engine->conns[i];
+    for (int k = 0; k < conn->queue_cnt; k++) {
+      req = &conn->queue[(conn->queue_head + k) % PIPELINE_DEPTH];
+      if (req->item == item && !req->hedge) {
+        return conn;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Milliseconds until the item the parser waits on is due a hedge
+ *
+ * That's once its node is past its p95. A node too slow to have gathered
+ * HEDGE_MIN_SAMPLES yet gets as long as the quickest p95 that can be
+ * trusted, so the parser isn't left waiting on it for want of numbers.
+ *
+ * @return -1 when no hedge is coming, for epoll_wait
+ **/
+int EngineHedgeTimeout(struct ChunkEngine *engine) {
+  struct ChunkSlot *slot = &engine->slots[engine->parse_item % engine->window];
+  struct EngineConnection *primary;
+  struct NodeStats *stats;
+  double due, p95 = 0;
+
+  if (engine->node_cnt < 2 || engine->parse_item >= engine->next_item || slot->ready ||
+      slot->hedged || (primary = EngineFindPrimary(engine, engine->parse_item)) == NULL) {
+    return -1;
+  }
+  if (primary->arNode->stats.samples >= HEDGE_MIN_SAMPLES) {
+    p95 = primary->arNode->stats.p95;
+  } else {
+    for (int i = 0; i < engine->conn_cnt; i++) {
+      stats = &engine->conns[i].arNode->stats;
+      if (stats->samples >= HEDGE_MIN_SAMPLES && (p95 == 0 || stats->p95 < p95)) {
+        p95 = stats->p95;
+      }
+    }
+    if (p95 == 0) {
+      return -1;
+    }
+  }
+  due = slot->requested_at + p95 - MonotonicSeconds();
+  return due > 0 ? (int)(due * 1000) + 1 : 0;
+}
+
+/**
+ * @brief Milliseconds epoll_wait may sleep before a hedge, a retry or a
+ *        node coming back from its backoff is due
+ * @return -1 when only socket events can move things along
+ **/
+int EngineTimeout(struct ChunkEngine *engine) {
+  int timeout = EngineHedgeTimeout(engine);
+  double now = MonotonicSeconds();
+  double due = 0, at;
+  int ms;
+
+  for (uint64_t item = engine->parse_item; engine->retry_cnt > 0 && item < engine->next_item;
+       item++) {
+    at = engine->slots[item % engine->window].retry_at;
+    if (at > now && (due == 0 || at < due)) {
+      due = at;
+    }
+  }
+  for (int i = 0; i < engine->conn_cnt; i++) {
+    at = engine->conns[i].arNode->stats.down_until;
+    if (at > now && (due == 0 || at < due)) {
+      due = at;
+    }
+  }
+  if (due == 0) {
+    return timeout;
+  }
+  ms = (int)((due - now) * 1000) + 1;
+  return timeout == -1 || ms < timeout ? ms : timeout;
+}
+
+/**
+ * @brief Ask a second node for the item the parser waits on, once the first
+ *        one is past its p95 latency and another node has pipeline room
+ **/
+void EngineMaybeHedge(struct ChunkEngine *engine) {
+  struct ChunkSlot *slot = &engine->slots[engine->parse_item % engine->window];
+  struct EngineConnection *primary, *conn;
+
+  if (EngineHedgeTimeout(engine) != 0) {
+    return;
+  }
+  primary = EngineFindPrimary(engine, engine->parse_item);
+  if ((conn = EnginePick(engine, primary->arNode, 1)) == NULL) {
+    return;
+  }
+  slot->hedged = 1;
+  conn->arNode->stats.hedges_sent++;
+  runStats.hedges++;
+  if (verbose) {
+    printf("hedging chunk %" PRIu64 " of %s on %s\n", engine->parse_item,
+           primary->arNode->domain, conn->arNode->domain);
+  }
+  EngineQueueRequest(engine, conn, engine->parse_item, 1);
+}
+
+/**
+ * @brief A hedge won, stop whoever is still writing the item into its slot
+ *
+ * The slot buffer is about to change hands, so the connection reading the
+ * first response into it is closed and reopened for the rest of its queue.
+ **/
+void EngineCancelPrimary(struct ChunkEngine *engine, struct EngineConnection *winner,
+                         uint64_t item, char *buffer) {
+  struct EngineConnection *conn;
+  struct EngineRequest *req;
+
+  for (int i = 0; i < engine->conn_cnt; i++) {
+    conn = &engine->conns[i];
+    if (conn == winner || conn->state != ENGINE_CONN_READING || conn->target != buffer) {
+      continue;
+    }
+    req = &conn->queue[conn->queue_head];
+    if (req->item != item) {
+      continue;
+    }
+    // what it took so far is a lower bound on the node's latency
+    NodeStatsSample(conn->arNode, MonotonicSeconds() - req->sent_at, 0);
+    conn->queue_head = (conn->queue_head + 1) % PIPELINE_DEPTH;
+    conn->queue_cnt--;
+    EngineRestart(engine, conn);
+  }
+}
+
+/**
+ * @brief The node closed the socket under us
+ *
+ * A kept-alive connection may be closed by the node at any time, in which
+ * case the requests still owed on it are written again on a fresh socket.
+ * A fresh socket that dies before answering anything fails its requests.
+ **/
+void EngineHangup(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  if (!conn->reused && conn->served == 0 && conn->queue_cnt > 0) {
+    EngineConnFailed(engine, conn);
+    return;
+  }
+  EngineRestart(engine, conn);
+}
+
+/**
+ * @brief Whether a complete response carries the chunk it was asked for
+ **/
+int EngineResponseOk(struct ChunkEngine *engine, struct EngineConnection *conn,
+                     uint64_t offset) {
+  if (conn->res.status >= 400) {
+    fprintf(stderr, "chunk offset %" PRId64 " came back with status %d from %s:%d\n", offset,
+            conn->res.status, conn->arNode->domain, conn->arNode->port);
+    return 0;
+  }
+  if (engine->arBundle->raw) {
+    if (conn->res.status != 206) {
+      fprintf(stderr, "range at offset %" PRId64 " came back with status %d\n", offset,
+              conn->res.status);
+      return 0;
+    }
+  } else if (conn->sink.state != CHUNK_FIELD_DONE) {
+    fprintf(stderr, "chunk offset %" PRId64 " has no chunk in its response\n", offset);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Take the response at the head of the connection's queue off it
+ *
+ * A response without its chunk fails the request, the connection carries on.
+ **/
+void EngineResponseDone(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  struct EngineRequest *req = &conn->queue[conn->queue_head];
+  struct ChunkSlot *slot = &engine->slots[req->item % engine->window];
+  uint64_t offset = engine->startOffset + req->item * MAX_CHUNK_SIZE;
+  char *buffer;
+  int len, ok;
+
+  if (verbose) {
+    printf("status=%d body=%" PRId64 "\n", conn->res.status, conn->res.body_len);
+  }
+  PoolRequestServed(conn->arNode, &conn->res);
+  len = engine->arBundle->raw ? conn->res.body_len : conn->sink.len;
+  ok = EngineResponseOk(engine, conn, offset);
+  if (!ok) {
+    EngineRequestFailed(engine, conn, req);
+    EngineNodeFailed(conn->arNode);
+  } else {
+    NodeStatsSample(conn->arNode, MonotonicSeconds() - req->sent_at, len);
+    conn->arNode->stats.failures = 0;
+  }
+
+  if (ok && req->item >= engine->parse_item && req->item < engine->next_item &&
+      !slot->ready) {
+    if (conn->target != slot->data) {
+      // the hedge beat the first request, its buffer becomes the slot's
+      buffer = slot->data;
+      EngineCancelPrimary(engine, conn, req->item, buffer);
+      slot->data = conn->target;
+      conn->scratch = buffer;
+      conn->arNode->stats.hedges_won++;
+    }
+    slot->len = len;
+    slot->ready = 1;
+    if (engine->arBundle->verifier != NULL) {
+      VerifierSubmit(engine->arBundle->verifier, offset, slot->data, len, conn->path,
+                     conn->sink.path_len);
+    }
+  }
+
+  conn->served++;
+  conn->queue_head = (conn->queue_head + 1) % PIPELINE_DEPTH;
+  conn->queue_cnt--;
+
+  if (!conn->res.keep_alive) {
+    EngineRestart(engine, conn);
+  } else if (conn->queue_cnt == 0) {
+    conn->state = ENGINE_CONN_IDLE;
+    conn->target = NULL;
+    EngineWatch(engine, conn, EPOLLIN, EPOLL_CTL_MOD);
+  } else {
+    EngineExpect(engine, conn);
+  }
+  EngineDispatch(engine);
+}
+
+void EngineRead(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  int r;
+
+  if (conn->state == ENGINE_CONN_IDLE) {
+    // nothing is owed on an idle socket, anything readable is the node closing it
+    char c;
+    if (recv(conn->sock, &c, 1, MSG_PEEK) == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    EngineClose(engine, conn);
+    return;
+  }
+
+  while (conn->state == ENGINE_CONN_READING) {
+    r = HttpPump(conn->sock, &conn->rd, &conn->res);
+    if (r == 0) {
+      return;
+    }
+    if (r == -1) {
+      uint64_t offset =
+        engine->startOffset + conn->queue[conn->queue_head].item * MAX_CHUNK_SIZE;
+
+      if (engine->arBundle->raw && conn->res.status != 0 && conn->res.status != 206) {
+        // a status line came in, so this isn't the node closing a stale socket
+        fprintf(stderr, "range at offset %" PRId64 " came back with status %d\n",
+                offset, conn->res.status);
+      } else if (!engine->arBundle->raw && conn->sink.state == CHUNK_FIELD_ERROR) {
+        fprintf(stderr, "chunk offset %" PRId64 " has a malformed chunk in its response\n",
+                offset);
+      } else {
+        EngineHangup(engine, conn);
+        return;
+      }
+      // the rest of the response is unusable, and so is the stream after it
+      EngineRequestFailed(engine, conn, &conn->queue[conn->queue_head]);
+      EngineNodeFailed(conn->arNode);
+      conn->queue_head = (conn->queue_head + 1) % PIPELINE_DEPTH;
+      conn->queue_cnt--;
+      EngineRestart(engine, conn);
+      return;
+    }
+    EngineResponseDone(engine, conn);
+  }
+}
+
+void EngineWrite(struct ChunkEngine *engine, struct EngineConnection *conn) {
+  int bytes_sent;
+
+  while (conn->out_sent < conn->out_len) {
+    bytes_sent = send(conn->sock, conn->out + conn->out_sent,
+                      conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+    if (bytes_sent == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      EngineHangup(engine, conn);
+      return;
+    }
+    conn->out_sent += bytes_sent;
+  }
+  EngineWatch(engine, conn, EPOLLIN, EPOLL_CTL_MOD);
+}
+
+void EngineHandle(struct ChunkEngine *engine, struct EngineConnection *conn, uint32_t events) {
+  int err = 0;
+  socklen_t errlen = sizeof(err);
+  struct sockaddr_in peer;
+  socklen_t peerlen = sizeof(peer);
+
+  if (conn->state == ENGINE_CONN_CONNECTING) {
+    getsockopt(conn->sock, SOL_SOCKET, SO_ERROR, &err, &errlen);
+    if (err != 0) {
+      errno = err;
+      perror("Connect");
+      EngineConnFailed(engine, conn);
+      return;
+    }
+    if (getpeername(conn->sock, (struct sockaddr *)&peer, &peerlen) == -1) {
+      // an event left over from the socket this one replaced, still connecting
+      return;
+    }
+    StatsRecord(STAT_CONNECT, MonotonicSeconds() - conn->connect_started);
+    conn->state = ENGINE_CONN_IDLE;
+    EngineWatch(engine, conn, EPOLLIN, EPOLL_CTL_MOD);
+    if (conn->queue_cnt > 0) {
+      EngineSendQueue(engine, conn);
+    }
+    return;
+  }
+
+  if ((events & EPOLLOUT) && conn->out_sent < conn->out_len) {
+    EngineWrite(engine, conn);
+  }
+  if (conn->sock >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+    EngineRead(engine, conn);
+  }
+}
+
+/**
+ * @return 0 on success, -1 when a chunk ran out of attempts
+ **/
+int ProcessBundleParallel(struct ArweaveNode *arNodes,
+                          int node_cnt,
+                          struct ArweaveBundle *arBundle,
+                          struct ArweaveBundleHeader *arBundleHeader,
+                          struct StateMachine *state,
+                          int jobs) {
+  struct ChunkEngine engine;
+  struct EngineConnection *conn;
+  struct ChunkSlot *slot;
+  struct epoll_event events[64];
+  uint64_t itemOffset;
+  int n;
+
+  engine.arBundle = arBundle;
+  engine.startOffset = arBundle->currentOffset;
+  engine.item_cnt = (FetchLimit(arBundle) - arBundle->currentOffset) / MAX_CHUNK_SIZE + 1;
+  engine.next_item = 0;
+  engine.parse_item = 0;
+  engine.window = jobs * PIPELINE_DEPTH;
+  engine.slots = calloc(engine.window, sizeof(struct ChunkSlot));
+  engine.conn_cnt = jobs;
+  engine.node_cnt = node_cnt;
+  engine.retry_cnt = 0;
+  engine.failed = 0;
+  engine.conns = calloc(jobs, sizeof(struct EngineConnection));
+  if (engine.slots == NULL || engine.conns == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  if ((engine.epfd = epoll_create1(0)) == -1) {
+    perror("epoll_create1");
+    exit(1);
+  }
+
+  // spread the connections over every --node given
+  for (int i = 0; i < jobs; i++) {
+    engine.conns[i].arNode = &arNodes[i % node_cnt];
+    engine.conns[i].sock = -1;
+    engine.conns[i].state = ENGINE_CONN_CLOSED;
+  }
+  EngineDispatch(&engine);
+
+  while (!engine.failed && engine.parse_item < engine.item_cnt &&
+         arBundle->currentOffset <= FetchLimit(arBundle)) {
+    slot = &engine.slots[engine.parse_item % engine.window];
+
+    if (!slot->ready) {
+      EngineDispatch(&engine);
+      EngineMaybeHedge(&engine);
+      n = epoll_wait(engine.epfd, events, 64, EngineTimeout(&engine));
+      if (n == -1 && errno != EINTR) {
+        perror("epoll_wait");
+        exit(1);
+      }
+      for (int i = 0; i < n; i++) {
+        EngineHandle(&engine, (struct EngineConnection *)events[i].data.ptr, events[i].events);
+      }
+      // a stalled node shouldn't hold a SIGUSR1 dump up
+      StatsPoll();
+      continue;
+    }
+
+    while (slot->ready && engine.parse_item < engine.item_cnt) {
+      // the chunk served for an aligned offset has to pick up where the
+      // previous one ended, otherwise a short chunk fell between two items
+      itemOffset = engine.startOffset + engine.parse_item * MAX_CHUNK_SIZE;
+      ConsumeChunk(&arNodes[0], arBundle, arBundleHeader, state, slot->len, slot->data);
+      if (arBundle->currentOffset <= itemOffset) {
+        fprintf(stderr, "chunks of %s aren't %d bytes aligned, rerun with --jobs 1\n",
+                arBundle->tx_id, MAX_CHUNK_SIZE);
+        exit(EXIT_FAILURE);
+      }
+      slot->ready = 0;
+      if (slot->retry_at > 0) {
+        // a hedge brought it in while the first request waited on a retry
+        slot->retry_at = 0;
+        engine.retry_cnt--;
+      }
+      engine.parse_item++;
+      if (arBundle->currentOffset > itemOffset + MAX_CHUNK_SIZE) {
+        EngineSkip(&engine, (arBundle->currentOffset - engine.startOffset) / MAX_CHUNK_SIZE);
+      }
+      // the parser may have moved fetchEndOffset, items past it stay unclaimed
+      engine.item_cnt = (FetchLimit(arBundle) - engine.startOffset) / MAX_CHUNK_SIZE + 1;
+      slot = &engine.slots[engine.parse_item % engine.window];
+    }
+
+    // the window moved, hand out more work
+    EngineDispatch(&engine);
+  }
+
+  // keep the still healthy sockets around for whoever asks the node next
+  for (int i = 0; i < engine.conn_cnt; i++) {
+    conn = &engine.conns[i];
+    if (conn->state == ENGINE_CONN_IDLE) {
+      struct ArweaveConnection idle;
+
+      epoll_ctl(engine.epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+      fcntl(conn->sock, F_SETFL, fcntl(conn->sock, F_GETFL) & ~O_NONBLOCK);
+      idle.sock = conn->sock;
+      idle.reused = 1;
+      idle.rd = conn->rd;
+      PoolRelease(conn->arNode, &idle, 1);
+      conn->sock = -1;
+    }
+    EngineClose(&engine, conn);
+    ChunkPoolRelease(&chunkPool, conn->scratch);
+    free(conn->path);
+  }
+
+  close(engine.epfd);
+  for (int i = 0; i < engine.window; i++) {
+    ChunkPoolRelease(&chunkPool, engine.slots[i].data);
+  }
+  free(engine.slots);
+  free(engine.conns);
+
+  return engine.failed ? -1 : 0;
+}
+
+/**
+ * @brief Check whether the node serves byte ranges of the bundle's data
+ *
+ * Asks /raw/<tx_id> for its first byte. Anything but a one byte 206 means
+ * the node doesn't do ranges there and the chunks have to come from /chunk.
+ *
+ * @return 1 when ranges are served, 0 otherwise
+ **/
+int ProbeRawRanges(struct ArweaveNode *arNode, struct ArweaveBundle *arBundle) {
+  struct ArweaveConnection conn;
+  struct HttpResponse res;
+  char send_data[1024];
+  char path[300];
+  char body[1];
+  int len, status;
+
+  sprintf(path, "raw/%s", arBundle->tx_id);
+  len = FormatRequest(arNode, path, "0-0", send_data, sizeof(send_data));
+
+  conn = PoolAcquire(arNode);
+  if (SendData(&conn, send_data, len) == -1) {
+    status = 0;
+  } else {
+    HttpResponseInit(&res, NULL, NULL);
+    HttpResponseDirect(&res, body, sizeof(body));
+    status = ReadResponse(arNode, &conn, &res);
+  }
+  if (status == 0 && conn.reused) {
+    // idle connection went stale in the pool, retry on a fresh one
+    PoolRelease(arNode, &conn, 0);
+    conn = PoolAcquire(arNode);
+    status = 0;
+    if (SendData(&conn, send_data, len) != -1) {
+      HttpResponseInit(&res, NULL, NULL);
+      HttpResponseDirect(&res, body, sizeof(body));
+      status = ReadResponse(arNode, &conn, &res);
+    }
+  }
+
+  // a 200 with the whole tx doesn't fit in body and fails the read
+  PoolRelease(arNode, &conn, status != 0 && res.keep_alive);
+  return status == 206 && res.body_len == 1;
+}
+
+/**
+ * @return 0 on success, -1 when a chunk couldn't be fetched
+ **/
+int FetchFromNodes(struct ArweaveNode *arNodes,
+                   int node_cnt,
+                   struct ArweaveBundle *arBundle,
+                   struct ArweaveBundleHeader *arBundleHeader,
+                   struct StateMachine *state,
+                   int jobs) {
+  if (jobs > 1) {
+    return ProcessBundleParallel(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs);
+  }
+  return ProcessBundleSequential(&arNodes[0], arBundle, arBundleHeader, state);
+}
+
+/**
+ * @brief Map the bundle at path, or read it off stdin when path is -
+ *
+ * Files and block devices are mapped for sequential readahead. A pipe
+ * can't be mapped, so it's read a chunk at a time as the parse gets to it,
+ * and its size is only known once the header is in. Only with whole set,
+ * for --recursive to hand out nested bundles in place, is it read in whole
+ * first.
+ **/
+void LocalOpen(struct LocalBundle *local, const char *path, int whole) {
+  uint64_t cap = 0;
+  off_t end;
+  ssize_t got;
+  int fd = STDIN_FILENO;
+
+  local->path = path;
+  local->mapped = 0;
+  local->buf = NULL;
+  if (strcmp(path, "-") != 0 && (fd = open(path, O_RDONLY)) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  // a block device has no st_size, but seeking to its end finds its size
+  if ((end = lseek(fd, 0, SEEK_END)) > 0) {
+    local->size = end;
+    local->data = mmap(NULL, local->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (local->data == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+    madvise(local->data, local->size, MADV_SEQUENTIAL);
+    local->mapped = 1;
+  } else if (!whole) {
+    local->data = NULL;
+    local->size = LOCAL_SIZE_UNKNOWN;
+    local->fd = fd;
+    local->buf_pos = 0;
+    local->buf_len = 0;
+    local->eof = 0;
+    if ((local->buf = malloc(MAX_CHUNK_SIZE)) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    return;
+  } else {
+    local->data = NULL;
+    local->size = 0;
+    do {
+      if (local->size == cap) {
+        cap = cap ? cap * 2 : 16 * MAX_CHUNK_SIZE;
+        if ((local->data = realloc(local->data, cap)) == NULL) {
+          perror("realloc");
+          exit(1);
+        }
+      }
+      if ((got = read(fd, local->data + local->size, cap - local->size)) == -1) {
+        perror("read");
+        exit(1);
+      }
+      local->size += got;
+    } while (got > 0);
+  }
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  if (local->size < 32) {
+    fprintf(stderr, "%s is too short to be a bundle\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+const char *LocalName(const struct LocalBundle *local) {
+  return strcmp(local->path, "-") == 0 ? "stdin" : local->path;
+}
+
+void LocalClose(struct LocalBundle *local) {
+  if (local->mapped) {
+    munmap(local->data, local->size);
+  } else {
+    free(local->data);
+  }
+  if (local->buf != NULL) {
+    if (local->fd != STDIN_FILENO) {
+      close(local->fd);
+    }
+    free(local->buf);
+  }
+}
+
+/**
+ * @brief Give a --file or --stdin bundle the offsets of one at weave offset 0
+ **/
+void LocalOffsets(struct LocalBundle *local, struct ArweaveBundle *arBundle) {
+  arBundle->size = local->size;
+  arBundle->startOffset = 0;
+  arBundle->endOffset = local->size - 1;
+  arBundle->currentOffset = 0;
+  if (local->size == LOCAL_SIZE_UNKNOWN) {
+    printf("size: unknown until the header of %s is in\n", LocalName(local));
+    return;
+  }
+  printf("size: %" PRIu64 " from %s\n", arBundle->size, LocalName(local));
+}
+
+/**
+ * @brief Read the piped bundle on up to the aligned chunk holding pos
+ *
+ * The chunks before it are read and dropped, there's no going back on a
+ * pipe; the parse only ever jumps ahead.
+ *
+ * @return Bytes of the chunk from pos on, 0 when the input ended first
+ **/
+uint64_t LocalRead(struct LocalBundle *local, uint64_t pos) {
+  uint64_t chunk = pos / MAX_CHUNK_SIZE * MAX_CHUNK_SIZE;
+  ssize_t got;
+
+  if (chunk < local->buf_pos) {
+    fprintf(stderr, "%s can't go back to byte %" PRIu64 "\n", LocalName(local), pos);
+    exit(1);
+  }
+  while (local->buf_pos < chunk || (local->buf_len < MAX_CHUNK_SIZE && !local->eof)) {
+    if (local->buf_len == MAX_CHUNK_SIZE) {
+      local->buf_pos += MAX_CHUNK_SIZE;
+      local->buf_len = 0;
+      continue;
+    }
+    if (local->eof) {
+      break;
+    }
+    if ((got = read(local->fd, local->buf + local->buf_len, MAX_CHUNK_SIZE - local->buf_len)) ==
+        -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("read");
+      exit(1);
+    }
+    local->buf_len += got;
+    local->eof = got == 0;
+  }
+  if (local->buf_pos != chunk || pos >= local->buf_pos + local->buf_len) {
+    return 0;
+  }
+  return local->buf_pos + local->buf_len - pos;
+}
+
+/**
+ * @brief The header of a piped bundle is in, so how long it is is known
+ **/
+void LocalHeaderDone(struct ArweaveBundle *arBundle, struct ArweaveBundleHeader *arBundleHeader) {
+  struct LocalBundle *local = arBundle->local;
+  uint32_t n = arBundleHeader->entry_cnt;
+
+  local->size = n == 0 ? 32 : arBundleHeader->starts[n - 1] + arBundleHeader->sizes[n - 1];
+  arBundle->size = local->size;
+  arBundle->endOffset = local->size - 1;
+  if (arBundle->fetchEndOffset > arBundle->endOffset) {
+    arBundle->fetchEndOffset = arBundle->endOffset;
+  }
+  printf("size: %" PRIu64 " from the header of %s\n", arBundle->size, LocalName(local));
+}
+
+/**
+ * @brief Parse the chunks from currentOffset to fetchEndOffset out of the
+ *        --file or --stdin bundle
+ **/
+int LocalChunks(struct ArweaveBundle *arBundle,
+                struct ArweaveBundleHeader *arBundleHeader,
+                struct StateMachine *state) {
+  struct LocalBundle *local = arBundle->local;
+  uint64_t pos, len;
+  int sized;
+
+  while (arBundle->currentOffset <= arBundle->fetchEndOffset) {
+    pos = arBundle->currentOffset - arBundle->startOffset;
+    len = MAX_CHUNK_SIZE - pos % MAX_CHUNK_SIZE;
+    if (local->data != NULL) {
+      if (len > local->size - pos) {
+        len = local->size - pos;
+      }
+      ProcessChunk(NULL, arBundle, arBundleHeader, state, len, local->data + pos);
+    } else {
+      sized = local->size != LOCAL_SIZE_UNKNOWN;
+      if ((len = LocalRead(local, pos)) == 0 && sized) {
+        fprintf(stderr, "%s ended at byte %" PRIu64 ", its header says %" PRIu64 "\n",
+                LocalName(local), local->buf_pos + local->buf_len, local->size);
+        return -1;
+      }
+      if (len == 0) {
+        // it ended before its header did, which the caller finds out
+        local->size = local->buf_pos + local->buf_len;
+        if (local->size < 32) {
+          fprintf(stderr, "%s is too short to be a bundle\n", LocalName(local));
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      if (len > local->size - pos) {
+        len = local->size - pos;
+      }
+      ProcessChunk(NULL, arBundle, arBundleHeader, state, len, local->buf + (pos - local->buf_pos));
+      if (!sized && state->header_done == 1) {
+        LocalHeaderDone(arBundle, arBundleHeader);
+      }
+    }
+    arBundle->currentOffset += len;
+    StatsChunk(len);
+    // pages the jump goes past are never read in
+    FetchJump(arBundle);
+  }
+  return 0;
+}
+
+/**
+ * @brief Fetch and parse the chunks from currentOffset to fetchEndOffset
+ *
+ * With a --cache, cached chunks are parsed from disk, and chunks a resumed
+ * run already parsed are skipped. Only the runs of chunks left go to the
+ * nodes. A --file or --stdin bundle never goes near them.
+ *
+ * @return 0 on success, -1 when a chunk couldn't be fetched
+ **/
+int FetchChunks(struct ArweaveNode *arNodes,
+                int node_cnt,
+                struct ArweaveBundle *arBundle,
+                struct ArweaveBundleHeader *arBundleHeader,
+                struct StateMachine *state,
+                int jobs) {
+  uint64_t runEnd;
+  int status;
+
+  arBundle->runEndOffset = UINT64_MAX;
+  if (arBundle->local != NULL) {
+    return LocalChunks(arBundle, arBundleHeader, state);
+  }
+  if (arBundle->cache == NULL && arBundle->checkpoint == NULL) {
+    return FetchFromNodes(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs);
+  }
+
+  while (arBundle->currentOffset <= arBundle->fetchEndOffset) {
+    if (CheckpointSkip(arBundle)) {
+      continue;
+    }
+    if (arBundle->cache != NULL && CacheConsume(&arNodes[0], arBundle, arBundleHeader, state)) {
+      continue;
+    }
+    runEnd = arBundle->currentOffset + MAX_CHUNK_SIZE;
+    while (runEnd <= arBundle->fetchEndOffset &&
+           (arBundle->cache == NULL || !CacheHas(arBundle->cache, runEnd)) &&
+           (arBundle->checkpoint == NULL ||
+            !CheckpointIsDone(arBundle->checkpoint, runEnd - arBundle->startOffset))) {
+      runEnd += MAX_CHUNK_SIZE;
+    }
+    arBundle->runEndOffset = runEnd - 1;
+    status = FetchFromNodes(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs);
+    arBundle->runEndOffset = UINT64_MAX;
+    if (status == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Pull the --item out of the bundle once the header is parsed
+ *
+ * Only the MAX_CHUNK_SIZE aligned chunks covering the item are fetched,
+ * and its bytes are written to a file named after the item id.
+ *
+ * @return 0 on success, -1 when a chunk couldn't be fetched
+ **/
+int ExtractItem(struct ArweaveNode *arNodes,
+                int node_cnt,
+                struct ArweaveBundle *arBundle,
+                struct ArweaveBundleHeader *arBundleHeader,
+                struct StateMachine *state,
+                int jobs) {
+  uint64_t itemStart, itemSize;
+  int64_t index;
+
+  if ((index = BundleHeaderFind(arBundleHeader, arBundle->item_id)) == -1) {
+    fprintf(stderr, "bundle %s holds no item %s\n", arBundle->tx_id, arBundle->item_id);
+    exit(EXIT_FAILURE);
+  }
+  itemStart = arBundleHeader->starts[index];
+  itemSize = arBundleHeader->sizes[index];
+
+  if (state->item_index != index || state->item_fd == -1) {
+    state->item_fd = CreateItemFile(arBundle->item_id, itemSize);
+    state->item_index = index;
+    state->item_written = 0;
+    // chunks the header pass parsed haven't had their item bytes written
+    CheckpointNewPass(arBundle);
+  }
+
+  if (itemSize > 0) {
+    arBundle->currentOffset = arBundle->startOffset + itemStart / MAX_CHUNK_SIZE * MAX_CHUNK_SIZE;
+    arBundle->fetchEndOffset = arBundle->startOffset + itemStart + itemSize - 1;
+    printf("item %" PRId64 " is at %" PRIu64 "+%" PRIu64 ", fetching %" PRIu64 " chunks\n",
+           index, itemStart, itemSize,
+           (arBundle->fetchEndOffset - arBundle->currentOffset) / MAX_CHUNK_SIZE + 1);
+    if (FetchChunks(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs) == -1) {
+      return -1;
+    }
+  }
+
+  if (state->item_written != itemSize) {
+    fprintf(stderr, "item %s came out short\n", arBundle->item_id);
+    exit(EXIT_FAILURE);
+  }
+  close(state->item_fd);
+  state->item_fd = -1;
+  state->item_index = -1;
+  printf("wrote %" PRIu64 " bytes of item %s to ./%s\n", itemSize, arBundle->item_id,
+         arBundle->item_id);
+  return 0;
+}
+
+/**
+ * @brief Check every --extract item found came out whole
+ * @return 0
+ **/
+int ExtractFinish(struct ArweaveBundle *arBundle, struct ExtractPlan *plan) {
+  struct ExtractTarget *t;
+  uint64_t bytes = 0;
+
+  for (uint32_t k = 0; k < plan->target_cnt; k++) {
+    t = &plan->targets[k];
+    if (t->size == 0) {
+      close(CreateItemFile(plan->wanted[t->want].id, 0));
+    }
+    if (t->written != t->size) {
+      fprintf(stderr, "item %s came out short\n", plan->wanted[t->want].id);
+      exit(EXIT_FAILURE);
+    }
+    bytes += t->size;
+  }
+  printf("wrote %u data items of %s, %" PRIu64 " bytes, to ./\n", plan->target_cnt,
+         arBundle->tx_id, bytes);
+  return 0;
+}
+
+/**
+ * @brief Check every data item made it to the --unbundle directory
+ **/
+int FinishUnbundle(struct ArweaveBundle *arBundle,
+                   struct ArweaveBundleHeader *arBundleHeader,
+                   struct StateMachine *state) {
+  uint32_t kept;
+
+  // empty items at the very end never overlap a chunk
+  while (state->item_index >= 0 && state->item_index < arBundleHeader->entry_cnt &&
+         (arBundleHeader->sizes[state->item_index] == 0 || ItemDropped(state, state->item_index))) {
+    if (ItemDropped(state, state->item_index)) {
+      UnbundleDropItem(arBundle, arBundleHeader, state);
+      continue;
+    }
+    UnbundleOpenItem(arBundle, arBundleHeader, state);
+    close(state->item_fd);
+    state->item_fd = -1;
+    state->item_index++;
+  }
+  if (state->item_index != arBundleHeader->entry_cnt) {
+    fprintf(stderr, "bundle %s ended inside item %" PRId64 "\n", arBundle->tx_id,
+            state->item_index);
+    exit(EXIT_FAILURE);
+  }
+  kept = arBundleHeader->entry_cnt;
+  for (uint32_t i = 0; state->item_drop != NULL && i < arBundleHeader->entry_cnt; i++) {
+    kept -= ItemDropped(state, i);
+  }
+  printf("unbundled %u data items to %s\n", kept, arBundle->unbundle_dir);
+  state->item_index = -1;
+  return 0;
+}
+
+/**
+ * @brief Give up on a bundle, leaving a checkpoint to --resume it from
+ * @return -1
+ **/
+int BundleFailed(struct ArweaveBundle *arBundle,
+                 struct ArweaveBundleHeader *arBundleHeader,
+                 struct StateMachine *state) {
+  if (arBundle->checkpoint != NULL) {
+    CheckpointSave(arBundle, arBundleHeader, state);
+    CheckpointEnd(arBundle, 0);
+    fprintf(stderr, "bundle %s failed, rerun with --resume %s to pick up where it stopped\n",
+            arBundle->tx_id, arBundle->checkpoint->dir);
+  } else {
+    fprintf(stderr, "bundle %s failed\n", arBundle->tx_id);
+  }
+  if (state->item_fd != -1) {
+    close(state->item_fd);
+    state->item_fd = -1;
+  }
+  state->item_index = -1;
+  // an --items line the chunks stopped inside of is closed, which unlocks
+  // the output for the --recursive workers and the next bundle
+  if (state->items != NULL) {
+    DataItemParserFinish(state->items);
+  }
+  if (state->nested != NULL) {
+    NestedScannerReset(state->nested);
+    NestedDrain(state->nested->pool);
+  }
+  return -1;
+}
+
+/**
+ * @brief Fetch and dissect one bundle, or pick it up where --resume left it
+ * @return 0 on success, -1 when its chunks couldn't be fetched
+ **/
+int ProcessBundle(struct ArweaveNode *arNodes,
+                  int node_cnt,
+                  struct ArweaveBundle *arBundle,
+                  struct ArweaveBundleHeader *arBundleHeader,
+                  struct StateMachine *state,
+                  int jobs) {
+  int status;
+
+  state->chunk_buffer_index = 0;
+  state->iter_index = 0;
+  state->di_cnt_done = -1;
+  state->offset_done = -1;
+  state->header_done = -1;
+  state->item_index = -1;
+  state->item_fd = -1;
+  // whatever the last bundle left half parsed, before its header goes
+  if (state->items != NULL) {
+    DataItemParserFinish(state->items);
+  }
+  BundleHeaderFree(arBundleHeader);
+  if (arBundle->filter != NULL) {
+    FilterBegin(arBundle->filter, arBundle, state);
+  }
+  if (arBundle->plan != NULL) {
+    ExtractReset(arBundle->plan);
+  }
+  if (state->nested != NULL) {
+    NestedScannerReset(state->nested);
+    // a --file is mapped until the nested bundles in it are done
+    state->nested->base = arBundle->local != NULL ? arBundle->local->data : NULL;
+  }
+
+  if (arBundle->raw && !ProbeRawRanges(&arNodes[0], arBundle)) {
+    printf("%s doesn't serve byte ranges of %s, falling back to /chunk\n",
+           arNodes[0].domain, arBundle->tx_id);
+    arBundle->raw = 0;
+  }
+
+  if (arBundle->verifier != NULL) {
+    VerifierBegin(arBundle->verifier, &arNodes[0], arBundle);
+  }
+
+  if (arBundle->checkpoint != NULL) {
+    CheckpointBegin(arBundle, arBundleHeader, state);
+  }
+  if (arBundle->index != NULL && (arBundle->item_id[0] != 0 || arBundle->plan != NULL) &&
+      state->header_done != 1) {
+    IndexLoadItem(arBundle, arBundleHeader, state);
+  }
+
+  arBundle->currentOffset = arBundle->startOffset;
+  arBundle->fetchEndOffset = arBundle->endOffset;
+  if ((arBundle->item_id[0] != 0 || arBundle->plan != NULL) && state->di_cnt_done == 1) {
+    // resumed past the count, which is where this gets set otherwise
+    arBundle->fetchEndOffset =
+      arBundle->startOffset + 32 + 64 * (uint64_t)arBundleHeader->data_item_cnt - 1;
+  } else if ((arBundle->item_id[0] != 0 || arBundle->plan != NULL) &&
+             arBundle->size > MAX_CHUNK_SIZE) {
+    // how far the header goes is known once its count is in
+    arBundle->fetchEndOffset = arBundle->startOffset + MAX_CHUNK_SIZE - 1;
+  }
+  if (arBundle->plan != NULL && state->header_done == 1) {
+    // the index stood in for the header, straight on to the first run
+    ExtractPlanBuild(arBundle, arBundleHeader);
+    FetchJump(arBundle);
+  }
+  // an --item resumed past the header goes straight on with the item
+  if ((arBundle->item_id[0] == 0 || state->header_done != 1) &&
+      FetchChunks(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs) == -1) {
+    return BundleFailed(arBundle, arBundleHeader, state);
+  }
+
+  status = 0;
+  if (arBundle->item_id[0] != 0 && state->header_done == 1) {
+    status = ExtractItem(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs);
+  } else if (arBundle->plan != NULL && state->header_done == 1) {
+    status = ExtractFinish(arBundle, arBundle->plan);
+  } else if (arBundle->unbundle_dir != NULL && state->header_done == 1) {
+    status = FinishUnbundle(arBundle, arBundleHeader, state);
+  }
+  if (status == -1) {
+    return BundleFailed(arBundle, arBundleHeader, state);
+  }
+  // an index stand in header only holds the --item or --extract items
+  if (arBundle->index_dir != NULL && arBundle->index == NULL && state->header_done == 1 &&
+      arBundleHeader->entry_cnt == arBundleHeader->data_item_cnt) {
+    IndexWrite(arBundle, arBundleHeader);
+  }
+  if (state->items != NULL) {
+    DataItemParserFinish(state->items);
+  }
+  if (state->nested != NULL) {
+    NestedScannerReset(state->nested);
+    NestedDrain(state->nested->pool);
+  }
+  if (arBundle->verifier != NULL) {
+    VerifierDrain(arBundle->verifier);
+  }
+  if (arBundle->checkpoint != NULL) {
+    CheckpointEnd(arBundle, 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Copy the text of a JSON token into a NUL terminated buffer
+ **/
+char *JsonTokenCopy(const char *json, jsmntok_t *tok, char *buf, int len) {
+  int n = tok->end - tok->start;
+
+  if (n >= len) {
+    n = len - 1;
+  }
+  memcpy(buf, json + tok->start, n);
+  buf[n] = 0;
+  return buf;
+}
+
+/**
+ * @brief Check a /tx/<id>/offset lookup came back with a 200
+ * @return 0 when it did, -1 otherwise
+ **/
+int CheckOffsetStatus(struct ArweaveNode *arNode, struct ArweaveBundle *arBundle, int status) {
+  if (status == 0) {
+    fprintf(stderr, "Fatal network error\n");
+    return -1;
+  }
+
+  if (status >= 400 && status < 500) {
+    fprintf(stderr, "tx %s wasn't found\n", arBundle->tx_id);
+    return -1;
+  }
+
+  if (status != 200) {
+    fprintf(stderr, "tx %s couldn't be fetched from %s\n", arBundle->tx_id,
+            arNode->domain);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Fill in the bundle's size and offsets from a /tx/<id>/offset body
+ * @return 0 on success, -1 when the body doesn't hold them
+ **/
+int ParseOffsetAndSize(struct ArweaveBundle *arBundle, char *body, int len) {
+  jsmn_parser parser;
+  jsmntok_t tokens[2048];
+  int parseResult;
+  char value[64];
+
+  body[len] = 0;
+  if (verbose) {
+    printf("Bytes recieved: %d\n", len);
+  }
+
+  jsmn_init(&parser);
+  parseResult = jsmn_parse(&parser, body, strlen(body), tokens, 2048);
+
+  if (parseResult < 0) {
+    fprintf(stderr, "Failed to parse JSON: %d\n", parseResult);
+    return -1;
+  }
+
+  arBundle->size = 0;
+  arBundle->endOffset = 0;
+
+  for (int i = 1; i < parseResult; i++) {
+    if (jsoneq(body, &tokens[i], "size") == 0) {
+      JsonTokenCopy(body, &tokens[i + 1], value, sizeof(value));
+      if (verbose) {
+        printf("size: %s\n", value);
+      }
+      arBundle->size = strToLong(value);
+    }
+    if (jsoneq(body, &tokens[i], "offset") == 0) {
+      JsonTokenCopy(body, &tokens[i + 1], value, sizeof(value));
+      if (verbose) {
+        printf("offset: %s\n", value);
+      }
+      arBundle->endOffset = strToLong(value);
+    }
+    i++;
+  }
+
+  if (arBundle->endOffset == 0) {
+    fprintf(stderr, "key 'offset' not found in json /offset response\n");
+    return -1;
+  }
+
+  if (arBundle->size == 0 || arBundle->size > arBundle->endOffset + 1) {
+    fprintf(stderr, "key 'size' not found in json /offset response\n");
+    return -1;
+  }
+
+  arBundle->startOffset = arBundle->endOffset - arBundle->size + 1;
+  arBundle->currentOffset = arBundle->startOffset;
+  return 0;
+}
+
+/**
+ * @brief Ask the node once for the tx offset
+ * @return HTTP status, 0 on a network error
+ **/
+int RequestOffset(struct ArweaveNode *arNode, struct ArweaveConnection *conn, const char *path,
+                  struct HttpResponse *res, struct PageSink *sink) {
+  sink->len = 0;
+  sink->overflow = 0;
+  HttpResponseInit(res, PageSinkWrite, sink);
+  if (SendRequest(arNode, conn, path) == -1) {
+    return 0;
+  }
+  return ReadResponse(arNode, conn, res);
+}
+
+/**
+ * @brief Look up where the bundle sits in the weave
+ *
+ * Network errors and 5xx answers are retried with a backoff.
+ *
+ * @return 0 on success, -1 on a lookup that kept failing or a 4xx
+ **/
+int GetOffsetAndSize(struct ArweaveNode *arNode,
+                     struct ArweaveBundle *arBundle) {
+
+  struct ArweaveConnection conn;
+  char path[256] = "tx/";
+
+  strcat(path, arBundle->tx_id);
+  strcat(path, "/offset");
+  if (verbose) {
+    printf("path: %s\n", path);
+  }
+
+  struct HttpResponse res;
+  char body[4096];
+  struct PageSink sink = {body, 0, sizeof(body) - 1, 0};
+  int status;
+
+  for (int attempt = 1;; attempt++) {
+    conn = PoolAcquire(arNode);
+    status = RequestOffset(arNode, &conn, path, &res, &sink);
+    if (status == 0 && conn.reused && !sink.overflow) {
+      // idle connection went stale in the pool, retry on a fresh one
+      PoolRelease(arNode, &conn, 0);
+      conn = PoolAcquire(arNode);
+      status = RequestOffset(arNode, &conn, path, &res, &sink);
+    }
+    if (status == 200 || sink.overflow || !RetryableStatus(status) ||
+        attempt == MAX_FETCH_ATTEMPTS) {
+      break;
+    }
+    PoolRelease(arNode, &conn, 0);
+    RetryWait(attempt);
+  }
+
+  if (CheckOffsetStatus(arNode, arBundle, status) == -1 ||
+      ParseOffsetAndSize(arBundle, body, sink.len) == -1) {
+    PoolRelease(arNode, &conn, 0);
+    return -1;
+  }
+
+  PoolRelease(arNode, &conn, res.keep_alive);
+
+  return 0;
+}
+
+/**
+ * Offset lookups of the bundles coming up in a --batch. They are pipelined
+ * on a connection of their own, so the node answers them while the bundles
+ * before are still being fetched.
+ **/
+struct OffsetLookahead {
+  struct ArweaveNode *arNode;
+  struct ArweaveConnection conn;
+  FILE *in;
+  int eof;
+  // tx ids with a lookup in flight, oldest at head
+  char ids[LOOKAHEAD_DEPTH][256];
+  int head;
+  int cnt;
+};
+
+/**
+ * @brief Read the next tx id of the batch, skipping blank and # lines
+ * @return 1 on success, 0 at the end of the input
+ **/
+int ReadTxId(FILE *in, char *txId, int len) {
+  char line[1024];
+  char *start, *end;
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    for (start = line; isspace((unsigned char)*start); start++) {
+    }
+    for (end = start + strlen(start); end > start && isspace((unsigned char)end[-1]); end--) {
+    }
+    *end = 0;
+    if (*start == 0 || *start == '#') {
+      continue;
+    }
+    if (end - start >= len) {
+      fprintf(stderr, "%s isn't a tx id\n", start);
+      exit(EXIT_FAILURE);
+    }
+    strcpy(txId, start);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Read the --extract list, one data item id a line
+ *
+ * The ids are sorted by their raw bytes, for the header walk to look each
+ * entry up, and an id listed twice is only pulled out once.
+ **/
+void ExtractLoad(struct ExtractPlan *plan, const char *path) {
+  FILE *in = stdin;
+  uint32_t cap = 0;
+  struct ExtractId *w;
+  char raw[48];
+  int rawLen;
+
+  memset(plan, 0, sizeof(*plan));
+  if (strcmp(path, "-") != 0 && (in = fopen(path, "r")) == NULL) {
+    perror("fopen");
+    exit(1);
+  }
+  for (;;) {
+    if (plan->cnt == cap) {
+      cap = cap ? cap * 2 : 256;
+      if ((plan->wanted = realloc(plan->wanted, cap * sizeof(struct ExtractId))) == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    w = &plan->wanted[plan->cnt];
+    if (!ReadTxId(in, w->id, sizeof(w->id))) {
+      break;
+    }
+    if (!base64urlDecode(w->id, strlen(w->id), raw, &rawLen) || rawLen != 32) {
+      fprintf(stderr, "%s isn't a data item id\n", w->id);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(w->raw, raw, 32);
+    plan->cnt++;
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+  if (plan->cnt == 0) {
+    fprintf(stderr, "%s lists no data item ids\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  qsort(plan->wanted, plan->cnt, sizeof(struct ExtractId), ExtractIdCompare);
+  cap = plan->cnt;
+  plan->cnt = 1;
+  for (uint32_t k = 1; k < cap; k++) {
+    if (ExtractIdCompare(&plan->wanted[k], &plan->wanted[plan->cnt - 1]) != 0) {
+      plan->wanted[plan->cnt++] = plan->wanted[k];
+    }
+  }
+}
+
+int LookaheadSend(struct OffsetLookahead *la, const char *txId) {
+  char path[300];
+
+  sprintf(path, "tx/%s/offset", txId);
+  return SendRequest(la->arNode, &la->conn, path);
+}
+
+/**
+ * @brief Keep LOOKAHEAD_DEPTH lookups in flight while the batch has ids left
+ **/
+void LookaheadFill(struct OffsetLookahead *la) {
+  char *txId;
+
+  while (la->cnt < LOOKAHEAD_DEPTH && !la->eof) {
+    txId = la->ids[(la->head + la->cnt) % LOOKAHEAD_DEPTH];
+    if (!ReadTxId(la->in, txId, sizeof(la->ids[0]))) {
+      la->eof = 1;
+      break;
+    }
+    // a failed send shows up as a hangup when its response is read
+    LookaheadSend(la, txId);
+    la->cnt++;
+  }
+}
+
+void LookaheadInit(struct OffsetLookahead *la, struct ArweaveNode *arNode, FILE *in) {
+  la->arNode = arNode;
+  la->in = in;
+  la->eof = 0;
+  la->head = 0;
+  la->cnt = 0;
+  la->conn = PoolAcquire(arNode);
+  LookaheadFill(la);
+}
+
+/**
+ * @brief Take the answer to the oldest lookup and line the next one up
+ * @param[out] arBundle Gets the tx id, size and offsets of the next bundle
+ * @return 1 on success, -1 when the lookup of the next bundle failed, 0
+ *         once the batch is done
+ **/
+int LookaheadNext(struct OffsetLookahead *la, struct ArweaveBundle *arBundle) {
+  struct HttpResponse res;
+  char body[4096];
+  struct PageSink sink = {body, 0, sizeof(body) - 1, 0};
+  int status, found;
+
+  if (la->cnt == 0) {
+    return 0;
+  }
+  strcpy(arBundle->tx_id, la->ids[la->head]);
+
+  HttpResponseInit(&res, PageSinkWrite, &sink);
+  status = ReadResponse(la->arNode, &la->conn, &res);
+  if (status == 0 && !sink.overflow) {
+    // the node dropped the connection, ask again for everything in flight
+    PoolRelease(la->arNode, &la->conn, 0);
+    la->conn = PoolAcquire(la->arNode);
+    for (int i = 0; i < la->cnt; i++) {
+      LookaheadSend(la, la->ids[(la->head + i) % LOOKAHEAD_DEPTH]);
+    }
+    sink.len = 0;
+    HttpResponseInit(&res, PageSinkWrite, &sink);
+    status = ReadResponse(la->arNode, &la->conn, &res);
+  }
+
+  if (status != 200 && !sink.overflow && RetryableStatus(status)) {
+    // the node is struggling, look this one up on its own with a backoff
+    // and line the rest up again on a fresh connection
+    PoolRelease(la->arNode, &la->conn, 0);
+    found = GetOffsetAndSize(la->arNode, arBundle) == 0;
+    res.keep_alive = 0;
+  } else {
+    found = CheckOffsetStatus(la->arNode, arBundle, status) == 0 &&
+            ParseOffsetAndSize(arBundle, body, sink.len) == 0;
+    if (status == 0) {
+      res.keep_alive = 0;
+    }
+  }
+
+  la->head = (la->head + 1) % LOOKAHEAD_DEPTH;
+  la->cnt--;
+  if (!res.keep_alive) {
+    PoolRelease(la->arNode, &la->conn, 0);
+    la->conn = PoolAcquire(la->arNode);
+    for (int i = 0; i < la->cnt; i++) {
+      LookaheadSend(la, la->ids[(la->head + i) % LOOKAHEAD_DEPTH]);
+    }
+  }
+  LookaheadFill(la);
+  return found ? 1 : -1;
+}
+
+/**
+ * @brief Dissect every bundle listed in a --batch input
+ *
+ * DNS, the node connection pools, the --cache and the offsets table are
+ * set up once and shared by all the bundles. A bundle that can't be looked
+ * up, whose chunks can't be fetched or that ends inside its header is
+ * skipped, the rest of the batch goes on.
+ *
+ * @return Number of bundles that failed
+ **/
+int RunBatch(struct ArweaveNode *arNodes,
+             int node_cnt,
+             struct ArweaveBundle *arBundle,
+             struct ArweaveBundleHeader *arBundleHeader,
+             struct StateMachine *state,
+             int jobs,
+             FILE *in) {
+  struct OffsetLookahead la;
+  int raw = arBundle->raw;
+  uint64_t bundles = 0;
+  uint64_t bytes = 0;
+  int failed = 0;
+  int next;
+  double start, elapsed;
+
+  start = MonotonicSeconds();
+  LookaheadInit(&la, &arNodes[0], in);
+
+  while ((next = LookaheadNext(&la, arBundle)) != 0) {
+    if (next == -1) {
+      failed++;
+      continue;
+    }
+    printf("bundle %s: %" PRIu64 " bytes\n", arBundle->tx_id, arBundle->size);
+    // a node may serve ranges of one bundle and not another
+    arBundle->raw = raw;
+    if (ProcessBundle(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs) == -1) {
+      failed++;
+      continue;
+    }
+    if (state->header_done != 1) {
+      fprintf(stderr, "bundle %s ended inside its header\n", arBundle->tx_id);
+      failed++;
+      continue;
+    }
+    bundles++;
+    bytes += arBundle->size;
+  }
+  PoolRelease(la.arNode, &la.conn, 1);
+
+  elapsed = MonotonicSeconds() - start;
+  printf("batch: %" PRIu64 " bundles, %.1f MB in %.2f s, %.1f bundles/sec, %.1f MB/sec\n",
+         bundles, bytes / 1e6, elapsed, bundles / elapsed, bytes / 1e6 / elapsed);
+  if (failed > 0) {
+    fprintf(stderr, "batch: %d bundles failed\n", failed);
+  }
+  return failed;
+}
+
+/**
+ * --bench and --serve: a synthetic node serving one generated ANS-104 bundle
+ * on loopback. SPEC is a comma separated list of key=value:
+ *   items=N       data items in the bundle (1000)
+ *   size=MIN-MAX  item sizes, log-uniform between the two, k and m suffixes
+ *                 allowed (1k-256k); items are at least a bare header long
+ *   chunks=N      keep adding items until the bundle is N chunks, overrides items
+ *   latency=MS    delay before every response, MS/MS/... for one per node,
+ *                 the last one going for the nodes after it (0)
+ *   bandwidth=MB  bytes/sec each node sends at most, shared by its connections,
+ *                 0 for unlimited (0)
+ *   nodes=N       nodes serving the same bundle, one port each (1)
+ *   port=N        first port to listen on, 0 picks free ones (0)
+ *   runs=N        --bench passes over the bundle (3)
+ *   seed=N        generator seed, the same seed gives the same bundle (1984)
+ *   hangup=N      close a connection after N responses without telling the
+ *                 client, as nodes dropping idle keep-alives do, 0 never (0)
+ *   short=N       serve every Nth chunk half short, 0 never (0); the bytes
+ *                 past it are lost, only --jobs 1 gets through such a bundle
+ *   ranges=0|1    whether /raw honours a Range, 0 sends the whole tx the way
+ *                 nodes without range support do (1)
+ **/
+struct SynthSpec {
+  uint32_t items;
+  uint64_t min_size;
+  uint64_t max_size;
+  uint64_t chunks;
+  // seconds, per node
+  double latency[MAX_NODES];
+  double bandwidth;
+  int nodes;
+  int port;
+  int runs;
+  uint64_t seed;
+  uint32_t hangup;
+  uint32_t short_every;
+  int ranges;
+};
+
+// The generated bundle and the /chunk bodies serving it, made up front so
+// the node spends its time sending rather than encoding
+struct SynthBundle {
+  char *data;
+  uint64_t size;
+  uint32_t item_cnt;
+  uint64_t end_offset;
+  uint64_t chunk_cnt;
+  char **chunk_json;
+  int *chunk_json_len;
+  uint8_t data_root[32];
+};
+
+// A node of the Merkle tree over the synthetic bundle's chunks
+struct SynthMerkleNode {
+  uint8_t id[32];
+  // chunk hash of a leaf
+  uint8_t hash[32];
+  // end offset of the last chunk under the node
+  uint64_t end;
+  // children, -1 for a leaf
+  int left;
+  int right;
+};
+
+struct SynthNode {
+  int listen_fd;
+  int port;
+  struct SynthSpec *spec;
+  struct SynthBundle *bundle;
+  double latency;
+  // the node's uplink, busy sending until link_free_at
+  pthread_mutex_t link_lock;
+  double link_free_at;
+};
+
+struct SynthConn {
+  struct SynthNode *node;
+  int sock;
+};
+
+// Sign type, signature, owner, target and anchor flags, tag count, tag bytes
+// and the tag block, one Synth-Shard tag of i % 100 for --filter to go by
+#define SYNTH_ITEM_TAGS_SIZE (1 + 1 + 11 + 1 + 2 + 1)
+#define SYNTH_ITEM_HEADER_SIZE (2 + 512 + 512 + 1 + 1 + 8 + 8 + SYNTH_ITEM_TAGS_SIZE)
+
+uint64_t SynthRandom(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+void SynthFill(uint64_t *state, char *out, uint64_t len) {
+  uint64_t r;
+
+  for (uint64_t i = 0; i < len; i += 8) {
+    r = SynthRandom(state);
+    memcpy(out + i, &r, len - i < 8 ? len - i : 8);
+  }
+}
+
+/**
+ * @brief Write a 32 byte little endian integer
+ **/
+void SynthPutU256(uint8_t *field, uint64_t value) {
+  memset(field, 0, 32);
+  for (int i = 0; i < 8; i++) {
+    field[i] = value >> (8 * i);
+  }
+}
+
+/**
+ * @brief Parse a size with an optional k or m suffix
+ * @return 0 on success, -1 if str isn't one
+ **/
+int SynthParseSize(const char *str, char **end, uint64_t *size) {
+  *size = strtoull(str, end, 10);
+  if (*end == str) {
+    return -1;
+  }
+  if (**end == 'k' || **end == 'K') {
+    *size *= 1024;
+    (*end)++;
+  } else if (**end == 'm' || **end == 'M') {
+    *size *= 1024 * 1024;
+    (*end)++;
+  }
+  return 0;
+}
+
+/**
+ * @brief Fill spec in from a --bench or --serve SPEC
+ * @return 0 on success, -1 on a key or value that doesn't parse
+ **/
+int SynthSpecParse(struct SynthSpec *spec, const char *str) {
+  char buf[512];
+  char *key, *value, *end, *save = NULL;
+  int latency_cnt = 0;
+
+  spec->items = 1000;
+  spec->min_size = 1024;
+  spec->max_size = 256 * 1024;
+  spec->chunks = 0;
+  spec->latency[0] = 0;
+  spec->bandwidth = 0;
+  spec->nodes = 1;
+  spec->port = 0;
+  spec->runs = 3;
+  spec->seed = 1984;
+  spec->hangup = 0;
+  spec->short_every = 0;
+  spec->ranges = 1;
+
+  strncpy(buf, str, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+  for (key = strtok_r(buf, ",", &save); key != NULL; key = strtok_r(NULL, ",", &save)) {
+    if ((value = strchr(key, '=')) == NULL) {
+      fprintf(stderr, "%s isn't key=value\n", key);
+      return -1;
+    }
+    *value++ = 0;
+    end = value;
+    if (strcmp(key, "items") == 0) {
+      spec->items = strtoul(value, &end, 10);
+    } else if (strcmp(key, "size") == 0) {
+      if (SynthParseSize(value, &end, &spec->min_size) == -1) {
+        end = value;
+      } else if (*end == '-') {
+        if (SynthParseSize(end + 1, &end, &spec->max_size) == -1) {
+          end = value;
+        }
+      } else {
+        spec->max_size = spec->min_size;
+      }
+    } else if (strcmp(key, "chunks") == 0) {
+      spec->chunks = strtoull(value, &end, 10);
+    } else if (strcmp(key, "latency") == 0) {
+      latency_cnt = 0;
+      for (char *ms = value; latency_cnt < MAX_NODES; ms = end + 1) {
+        spec->latency[latency_cnt++] = strtod(ms, &end) / 1000;
+        if (end == ms || *end != '/') {
+          break;
+        }
+      }
+      if (*end != 0 || end[-1] == '/') {
+        end = value;
+      }
+    } else if (strcmp(key, "bandwidth") == 0) {
+      spec->bandwidth = strtod(value, &end) * 1e6;
+    } else if (strcmp(key, "nodes") == 0) {
+      spec->nodes = atoi(value);
+      end = value + strspn(value, "0123456789");
+    } else if (strcmp(key, "port") == 0) {
+      spec->port = atoi(value);
+      end = value + strspn(value, "0123456789");
+    } else if (strcmp(key, "runs") == 0) {
+      spec->runs = atoi(value);
+      end = value + strspn(value, "0123456789");
+    } else if (strcmp(key, "seed") == 0) {
+      spec->seed = strtoull(value, &end, 10);
+    } else if (strcmp(key, "hangup") == 0) {
+      spec->hangup = strtoul(value, &end, 10);
+    } else if (strcmp(key, "short") == 0) {
+      spec->short_every = strtoul(value, &end, 10);
+    } else if (strcmp(key, "ranges") == 0) {
+      spec->ranges = atoi(value);
+      end = value + strspn(value, "01");
+    } else {
+      fprintf(stderr, "unknown bench key %s\n", key);
+      return -1;
+    }
+    if (end == value || *end != 0) {
+      fprintf(stderr, "bad value for %s: %s\n", key, value);
+      return -1;
+    }
+  }
+
+  if (spec->min_size < SYNTH_ITEM_HEADER_SIZE) {
+    spec->min_size = SYNTH_ITEM_HEADER_SIZE;
+  }
+  if (spec->max_size < spec->min_size) {
+    spec->max_size = spec->min_size;
+  }
+  for (int i = latency_cnt > 0 ? latency_cnt : 1; i < MAX_NODES; i++) {
+    spec->latency[i] = spec->latency[i - 1];
+  }
+  if (spec->nodes < 1 || spec->nodes > MAX_NODES || spec->runs < 1 ||
+      (spec->items == 0 && spec->chunks == 0)) {
+    fprintf(stderr, "bench needs 1 to %d nodes, a run and an item\n", MAX_NODES);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Draw an item size, uniform within a power of two picked uniformly
+ *        between min and max, which is log-uniform without libm
+ **/
+uint64_t SynthItemSize(struct SynthSpec *spec, uint64_t *state) {
+  int octaves = 0;
+  uint64_t low, size;
+
+  while ((spec->min_size << (octaves + 1)) <= spec->max_size && octaves < 40) {
+    octaves++;
+  }
+  if (spec->min_size == spec->max_size) {
+    return spec->min_size;
+  }
+  low = spec->min_size << (octaves > 0 ? SynthRandom(state) % (octaves + 1) : 0);
+  size = low + SynthRandom(state) % low;
+  return size > spec->max_size ? spec->max_size : size;
+}
+
+/**
+ * @brief Write a 32 byte big endian Merkle note
+ **/
+void SynthPutNote(uint8_t *note, uint64_t value) {
+  memset(note, 0, 32);
+  for (int i = 0; i < 8; i++) {
+    note[31 - i] = value >> (8 * i);
+  }
+}
+
+/**
+ * @brief Build the Merkle tree over the bundle's chunks
+ *
+ * Same tree a node builds: the leaves pair up level by level and an odd
+ * node out moves up a level as it is.
+ *
+ * @param[out] root Index of the root node
+ * @return The nodes, leaves first
+ **/
+struct SynthMerkleNode *SynthMerkleTree(struct SynthBundle *bundle, int *root) {
+  struct SynthMerkleNode *nodes;
+  uint8_t parts[96];
+  uint64_t len;
+  int cnt = bundle->chunk_cnt;
+  int level = 0, levelCnt = cnt;
+
+  // halving a level leaves one node over at most, once per level
+  if ((nodes = malloc((2 * cnt + 64) * sizeof(struct SynthMerkleNode))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (int i = 0; i < cnt; i++) {
+    len = bundle->size - (uint64_t)i * MAX_CHUNK_SIZE < MAX_CHUNK_SIZE ?
+      bundle->size - (uint64_t)i * MAX_CHUNK_SIZE : MAX_CHUNK_SIZE;
+    Sha256(bundle->data + (uint64_t)i * MAX_CHUNK_SIZE, len, nodes[i].hash);
+    nodes[i].end = (uint64_t)i * MAX_CHUNK_SIZE + len;
+    memcpy(parts, nodes[i].hash, 32);
+    SynthPutNote(parts + 32, nodes[i].end);
+    MerkleNodeId(parts, 2, nodes[i].id);
+    nodes[i].left = nodes[i].right = -1;
+  }
+
+  while (levelCnt > 1) {
+    int next = level + levelCnt;
+    int nextCnt = 0;
+
+    for (int i = level; i < level + levelCnt; i += 2) {
+      struct SynthMerkleNode *node = &nodes[next + nextCnt++];
+
+      if (i + 1 == level + levelCnt) {
+        *node = nodes[i];
+        continue;
+      }
+      memcpy(parts, nodes[i].id, 32);
+      memcpy(parts + 32, nodes[i + 1].id, 32);
+      SynthPutNote(parts + 64, nodes[i].end);
+      MerkleNodeId(parts, 3, node->id);
+      node->end = nodes[i + 1].end;
+      node->left = i;
+      node->right = i + 1;
+    }
+    level = next;
+    levelCnt = nextCnt;
+  }
+  memcpy(bundle->data_root, nodes[level].id, 32);
+  *root = level;
+  return nodes;
+}
+
+/**
+ * @brief data_path of chunk i: the branches from the root down, then the leaf
+ * @return Length of the path
+ **/
+int SynthDataPath(struct SynthMerkleNode *nodes, int root, uint64_t i, uint8_t *path) {
+  struct SynthMerkleNode *node = &nodes[root];
+  int len = 0;
+
+  while (node->left != -1) {
+    memcpy(path + len, nodes[node->left].id, 32);
+    memcpy(path + len + 32, nodes[node->right].id, 32);
+    SynthPutNote(path + len + 64, nodes[node->left].end);
+    len += 96;
+    node = &nodes[i * MAX_CHUNK_SIZE < nodes[node->left].end ? node->left : node->right];
+  }
+  memcpy(path + len, node->hash, 32);
+  SynthPutNote(path + len + 32, node->end);
+  return len + 64;
+}
+
+/**
+ * @brief Lay out the bundle the spec asks for and encode its /chunk bodies
+ *
+ * Data items carry an arweave signature type header with random signature
+ * and owner, no target or anchor, one Synth-Shard tag of their index % 100
+ * for --filter to pick a share of them by, and random data. Ids are random
+ * too; nothing downstream hashes the signature. The chunks carry real
+ * data_paths, so --verify has proofs to check.
+ **/
+void SynthGenerate(struct SynthSpec *spec, struct SynthBundle *bundle) {
+  uint64_t state = spec->seed ? spec->seed : 1;
+  uint64_t *sizes = NULL;
+  uint64_t total = 32;
+  uint32_t cnt = 0, cap = 0;
+  uint64_t pos, len;
+  char *item;
+  struct SynthMerkleNode *nodes;
+  uint8_t path[DATA_PATH_MAX_SIZE];
+  int root, pathLen;
+
+  while (spec->chunks > 0 ? total < spec->chunks * MAX_CHUNK_SIZE : cnt < spec->items) {
+    if (cnt == cap) {
+      cap = cap ? cap * 2 : 1024;
+      if ((sizes = realloc(sizes, cap * sizeof(uint64_t))) == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    sizes[cnt] = SynthItemSize(spec, &state);
+    total += 64 + sizes[cnt];
+    cnt++;
+  }
 
-  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-    perror("Socket");
+  bundle->size = total;
+  bundle->item_cnt = cnt;
+  bundle->end_offset = 1000000000000ULL + total - 1;
+  if ((bundle->data = malloc(total)) == NULL) {
+    perror("malloc");
     exit(1);
   }
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(arNode->port);
-  server_addr.sin_addr = *((struct in_addr *)arNode->host->h_addr);
-  bzero(&(server_addr.sin_zero), 8);
+  SynthPutU256((uint8_t *)bundle->data, cnt);
+  pos = 32 + 64 * (uint64_t)cnt;
+  for (uint32_t i = 0; i < cnt; i++) {
+    SynthPutU256((uint8_t *)bundle->data + 32 + 64 * (uint64_t)i, sizes[i]);
+    SynthFill(&state, bundle->data + 32 + 64 * (uint64_t)i + 32, 32);
+
+    item = bundle->data + pos;
+    memset(item, 0, SYNTH_ITEM_HEADER_SIZE);
+    item[0] = 1;
+    SynthFill(&state, item + 2, 1024);
+    // Avro block of one {name, value} with zigzag lengths, then the 0 block
+    item[1028] = 1;
+    item[1036] = SYNTH_ITEM_TAGS_SIZE;
+    snprintf(item + 1044, SYNTH_ITEM_TAGS_SIZE, "%c%cSynth-Shard%c%02u", 2, 22, 4, i % 100);
+    SynthFill(&state, item + SYNTH_ITEM_HEADER_SIZE, sizes[i] - SYNTH_ITEM_HEADER_SIZE);
+    pos += sizes[i];
+  }
+  free(sizes);
 
-  if (connect(sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) ==
-      -1) {
-    perror("Connect");
+  bundle->chunk_cnt = (total + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
+  bundle->chunk_json = malloc(bundle->chunk_cnt * sizeof(char *));
+  bundle->chunk_json_len = malloc(bundle->chunk_cnt * sizeof(int));
+  if (bundle->chunk_json == NULL || bundle->chunk_json_len == NULL) {
+    perror("malloc");
     exit(1);
   }
+  nodes = SynthMerkleTree(bundle, &root);
+  for (uint64_t i = 0; i < bundle->chunk_cnt; i++) {
+    const char *prefix = "{\"tx_path\":\"\",\"packing\":\"unpacked\",\"data_path\":\"";
+    const char *middle = "\",\"chunk\":\"";
+    int prefixLen = strlen(prefix), middleLen = strlen(middle);
+    char *json;
+    int n;
+
+    len = total - i * MAX_CHUNK_SIZE < MAX_CHUNK_SIZE ? total - i * MAX_CHUNK_SIZE
+                                                        : MAX_CHUNK_SIZE;
+    if (spec->short_every > 0 && i + 1 < bundle->chunk_cnt && (i + 1) % spec->short_every == 0) {
+      len /= 2;
+    }
+    pathLen = SynthDataPath(nodes, root, i, path);
+    if ((json = malloc(prefixLen + (pathLen * 4 + 2) / 3 + middleLen + (len * 4 + 2) / 3 + 3)) ==
+        NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    memcpy(json, prefix, prefixLen);
+    n = prefixLen + base64urlEncode(path, pathLen, json + prefixLen);
+    memcpy(json + n, middle, middleLen);
+    n += middleLen;
+    n += base64urlEncode((uint8_t *)bundle->data + i * MAX_CHUNK_SIZE, len, json + n);
+    json[n++] = '"';
+    json[n++] = '}';
+    bundle->chunk_json_len[i] = n;
+    bundle->chunk_json[i] = json;
+  }
+  free(nodes);
+}
 
-  snprintf(send_data, sizeof(send_data), "GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n",
-           path, arNode->domain);
-
-  if (send(sock, send_data, strlen(send_data), 0) == -1) {
-    perror("send");
-    exit(2);
+/**
+ * @brief Send len bytes, no faster than the node's bandwidth allows
+ * @param[in] flags MSG_MORE while more of the response follows
+ * @return 0 on success, -1 once the client went away
+ **/
+int SynthSend(struct SynthNode *node, int sock, const char *data, uint64_t len, int flags) {
+  struct timespec ts;
+  double now, until;
+  int slice, sent;
+
+  while (len > 0) {
+    slice = len < HTTP_READ_BUFFER_SIZE ? len : HTTP_READ_BUFFER_SIZE;
+    if (node->spec->bandwidth > 0) {
+      // book the slice on the uplink and wait out its transmission time
+      pthread_mutex_lock(&node->link_lock);
+      now = MonotonicSeconds();
+      if (node->link_free_at < now) {
+        node->link_free_at = now;
+      }
+      node->link_free_at += slice / node->spec->bandwidth;
+      until = node->link_free_at;
+      pthread_mutex_unlock(&node->link_lock);
+      if (until > now) {
+        ts.tv_sec = (time_t)(until - now);
+        ts.tv_nsec = (long)((until - now - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+      }
+    }
+    if ((sent = send(sock, data, slice, MSG_NOSIGNAL | flags)) <= 0) {
+      return -1;
+    }
+    data += sent;
+    len -= sent;
   }
+  return 0;
+}
 
-  int contentlengh;
-  int status;
-  char *body;
+int SynthRespond(struct SynthNode *node, int sock, int status, const char *extra,
+                 const char *body, uint64_t len) {
+  char head[512];
+  int headLen;
+
+  headLen = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\nContent-Length: %" PRIu64
+                     "\r\nConnection: keep-alive\r\n%s\r\n",
+                     status, status < 300 ? "OK" : "Not Found", len, extra);
+  // the head waits for the body, a small body goes out in the same segment
+  if (SynthSend(node, sock, head, headLen, MSG_MORE) == -1) {
+    return -1;
+  }
+  return SynthSend(node, sock, body, len, 0);
+}
 
-  if ((status = ReadHttpStatus(sock)) && (contentlengh = ParseHeader(sock))) {
+/**
+ * @brief Answer one request: /tx/<id>/offset, /chunk/<offset> and
+ *        /raw/<id> with or without a Range, whatever the id
+ **/
+int SynthServe(struct SynthNode *node, int sock, const char *request) {
+  struct SynthBundle *bundle = node->bundle;
+  uint64_t start = bundle->end_offset - bundle->size + 1;
+  uint64_t offset, first, last;
+  char path[1024];
+  char body[256];
+  char extra[128];
+  const char *range;
+  struct timespec ts;
+
+  if (node->latency > 0) {
+    ts.tv_sec = (time_t)node->latency;
+    ts.tv_nsec = (long)((node->latency - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+  if (sscanf(request, "GET %1023s", path) != 1) {
+    return -1;
+  }
 
-    if (status == 0) {
-      fprintf(stderr, "Fatal network error\n");
-      exit(EXIT_FAILURE);
+  if (strncmp(path, "/tx/", 4) == 0 && strstr(path, "/offset") != NULL) {
+    snprintf(body, sizeof(body), "{\"size\":\"%" PRIu64 "\",\"offset\":\"%" PRIu64 "\"}",
+             bundle->size, bundle->end_offset);
+    return SynthRespond(node, sock, 200, "", body, strlen(body));
+  }
+  if (strncmp(path, "/tx/", 4) == 0 && strstr(path, "/data_root") != NULL) {
+    base64urlEncode(bundle->data_root, 32, body);
+    return SynthRespond(node, sock, 200, "", body, strlen(body));
+  }
+  if (strncmp(path, "/chunk/", 7) == 0) {
+    offset = strtoull(path + 7, NULL, 10);
+    if (offset < start || offset > bundle->end_offset) {
+      return SynthRespond(node, sock, 404, "", "", 0);
     }
-
-    if (status >= 400 && status < 500) {
-      fprintf(stderr, "tx %s wasn't found\n", arBundle->tx_id);
-      exit(EXIT_FAILURE);
+    offset = (offset - start) / MAX_CHUNK_SIZE;
+    return SynthRespond(node, sock, 200, "", bundle->chunk_json[offset],
+                        bundle->chunk_json_len[offset]);
+  }
+  if (strncmp(path, "/raw/", 5) == 0) {
+    if (!node->spec->ranges || (range = strstr(request, "\r\nRange: bytes=")) == NULL) {
+      return SynthRespond(node, sock, 200, "", bundle->data, bundle->size);
     }
-
-    if (status != 200) {
-      fprintf(stderr, "tx %s couldn't be fetched from %s\n", arBundle->tx_id,
-              arNode->domain);
-      exit(EXIT_FAILURE);
+    if (sscanf(range + 15, "%" SCNu64 "-%" SCNu64, &first, &last) != 2 || first > last ||
+        first >= bundle->size) {
+      return SynthRespond(node, sock, 404, "", "", 0);
     }
+    if (last >= bundle->size) {
+      last = bundle->size - 1;
+    }
+    snprintf(extra, sizeof(extra), "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64 "\r\n",
+             first, last, bundle->size);
+    return SynthRespond(node, sock, 206, extra, bundle->data + first, last - first + 1);
+  }
+  return SynthRespond(node, sock, 404, "", "", 0);
+}
 
-    int bytes_received;
-    int bytes = 0;
-    body = (char *)malloc((contentlengh + 1) * sizeof(char));
-
-    /* FILE *fd = fopen("test.png", "wb"); */
-    printf("Saving data...\n\n");
+/**
+ * @brief Serve one client connection, pipelined requests in order
+ **/
+void *SynthConnThread(void *arg) {
+  struct SynthConn *conn = arg;
+  uint32_t hangup = conn->node->spec->hangup;
+  uint32_t served = 0;
+  char buf[16384];
+  int len = 0, n;
+  char *end;
 
-    while ((bytes_received = recv(sock, recv_data, 1024, 0))) {
-      if (bytes_received == -1) {
-        perror("recieve");
-        exit(3);
+  for (;;) {
+    while ((end = memmem(buf, len, "\r\n\r\n", 4)) != NULL) {
+      *end = 0;
+      if (SynthServe(conn->node, conn->sock, buf) == -1 || ++served == hangup) {
+        goto done;
       }
+      n = end + 4 - buf;
+      memmove(buf, buf + n, len - n);
+      len -= n;
+    }
+    if (len == sizeof(buf) - 1 || (n = recv(conn->sock, buf + len, sizeof(buf) - 1 - len, 0)) <= 0) {
+      break;
+    }
+    len += n;
+  }
+done:
+  close(conn->sock);
+  free(conn);
+  return NULL;
+}
 
-      /* body[bytes] = recv_data; */
-      strcpy((char *)body, recv_data);
+void *SynthAcceptThread(void *arg) {
+  struct SynthNode *node = arg;
+  struct SynthConn *conn;
+  pthread_t thread;
+  int sock;
 
-      /* fwrite(recv_data, 1, bytes_received, fd); */
-      bytes += bytes_received;
-      printf("Bytes recieved: %d from %d\n", bytes, contentlengh);
-      if (bytes == contentlengh) {
-        break;
+  for (;;) {
+    if ((sock = accept(node->listen_fd, NULL, NULL)) == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
       }
+      perror("accept");
+      exit(1);
+    }
+    if ((conn = malloc(sizeof(struct SynthConn))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    conn->node = node;
+    conn->sock = sock;
+    if (pthread_create(&thread, NULL, SynthConnThread, conn) != 0) {
+      perror("pthread_create");
+      exit(1);
     }
+    pthread_detach(thread);
   }
+  return NULL;
+}
 
-  jsmn_init(&parser);
-  parseResult = jsmn_parse(&parser, body, strlen(body), tokens, 2048);
+/**
+ * @brief Bind a node's listening socket on loopback
+ * @param[in] port Port to take, 0 for any free one
+ * @return Port bound
+ **/
+int SynthListen(struct SynthNode *node, int port) {
+  struct sockaddr_in addr;
+  socklen_t addrLen = sizeof(addr);
+  int one = 1;
 
-  if (parseResult < 0) {
-    fprintf(stderr, "Failed to parse JSON: %d\n", parseResult);
+  if ((node->listen_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    perror("Socket");
+    exit(1);
+  }
+  setsockopt(node->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(node->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(node->listen_fd, 256) == -1 ||
+      getsockname(node->listen_fd, (struct sockaddr *)&addr, &addrLen) == -1) {
+    perror("bind");
     exit(1);
   }
+  return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Generate the bundle and serve it until killed
+ * @param[in] readyFd The ports are written here once they listen, -1 to
+ *            print them instead
+ **/
+void SynthRun(struct SynthSpec *spec, int readyFd) {
+  struct SynthBundle bundle;
+  struct SynthNode nodes[MAX_NODES];
+  pthread_t threads[MAX_NODES];
+  int ports[MAX_NODES];
+
+  SynthGenerate(spec, &bundle);
+  for (int i = 0; i < spec->nodes; i++) {
+    nodes[i].spec = spec;
+    nodes[i].bundle = &bundle;
+    nodes[i].latency = spec->latency[i];
+    nodes[i].link_free_at = 0;
+    pthread_mutex_init(&nodes[i].link_lock, NULL);
+    ports[i] = nodes[i].port = SynthListen(&nodes[i], spec->port ? spec->port + i : 0);
+  }
 
-  for (int i = 1; i < parseResult; i++) {
-    if (jsoneq(body, &tokens[i], "size") == 0) {
-      printf("size: %s\n", strndup(body + tokens[i + 1].start, tokens[i + 1].end - tokens[i + 1].start));
-      /* printf("dim: start %d end %d size %d\n", tokens[i + 1].start, tokens[i + 1].end, tokens[i + 1].size); */
-      arBundle->size = strToLong(strndup(body + tokens[i + 1].start, tokens[i + 1].end - tokens[i + 1].start));
+  if (readyFd >= 0) {
+    if (write(readyFd, ports, spec->nodes * sizeof(int)) != (ssize_t)(spec->nodes * sizeof(int))) {
+      exit(1);
     }
-    if (jsoneq(body, &tokens[i], "offset") == 0) {
-      printf("offset: %s\n", strndup(body + tokens[i + 1].start, tokens[i + 1].end - tokens[i + 1].start));
-      arBundle->endOffset = strToLong(strndup(body + tokens[i + 1].start, tokens[i + 1].end - tokens[i + 1].start));
+    close(readyFd);
+  } else {
+    printf("serving %u data items, %" PRIu64 " bytes in %" PRIu64 " chunks on",
+           bundle.item_cnt, bundle.size, bundle.chunk_cnt);
+    for (int i = 0; i < spec->nodes; i++) {
+      printf(" 127.0.0.1:%d", ports[i]);
     }
-    i++;
+    printf("\n");
+    fflush(stdout);
   }
 
-  if (arBundle->endOffset < 0) {
-    fprintf(stderr, "key 'size' not found in json /offset response\n");
-    exit(1);
+  for (int i = 0; i < spec->nodes; i++) {
+    if (pthread_create(&threads[i], NULL, SynthAcceptThread, &nodes[i]) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < spec->nodes; i++) {
+    pthread_join(threads[i], NULL);
   }
+}
 
-  if (arBundle->size < 0) {
-    fprintf(stderr, "key 'offset' not found in json /offset response\n");
+/**
+ * @brief Fork the synthetic nodes off and point arNodes at them
+ *
+ * They run in a child so neither their CPU time nor their memory is
+ * charged to the run being measured.
+ *
+ * @return Pid of the child
+ **/
+pid_t BenchStart(struct SynthSpec *spec, struct ArweaveNode *arNodes, int *node_cnt) {
+  int ports[MAX_NODES];
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    exit(1);
+  }
+  fflush(stdout);
+  if ((pid = fork()) == -1) {
+    perror("fork");
     exit(1);
   }
+  if (pid == 0) {
+    close(fds[0]);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    SynthRun(spec, fds[1]);
+    _exit(0);
+  }
 
-  arBundle->startOffset = arBundle->endOffset - arBundle->size + 1;
-  arBundle->currentOffset = arBundle->startOffset;
+  close(fds[1]);
+  if (read(fds[0], ports, spec->nodes * sizeof(int)) != (ssize_t)(spec->nodes * sizeof(int))) {
+    fprintf(stderr, "the synthetic node didn't come up\n");
+    exit(1);
+  }
+  close(fds[0]);
 
-  /* printf("BODY: %s\n", body); */
-  /* printf("SIZe: %" PRId64 "\n", arBundle->size); */
-  /* printf("SIZe: %" PRId64 "\n", arBundle->offset); */
+  for (int i = 0; i < spec->nodes; i++) {
+    snprintf(arNodes[i].domain, sizeof(arNodes[i].domain), "127.0.0.1:%d", ports[i]);
+  }
+  *node_cnt = spec->nodes;
+  return pid;
+}
 
-  close(sock);
+/**
+ * @brief Dissect the synthetic bundle spec->runs times and report how fast
+ *
+ * Every run goes through ProcessBundle with whatever --jobs, --raw,
+ * --unbundle and --item were given, after a /tx/<id>/offset lookup.
+ **/
+int RunBench(struct SynthSpec *spec,
+             struct ArweaveNode *arNodes,
+             int node_cnt,
+             struct ArweaveBundle *arBundle,
+             struct ArweaveBundleHeader *arBundleHeader,
+             struct StateMachine *state,
+             int jobs) {
+  int raw = arBundle->raw;
+  double start, secs, mbps, best = 0, bestChunks = 0;
+  uint64_t chunks;
+  struct rusage usage;
+
+  for (int run = 1; run <= spec->runs; run++) {
+    start = MonotonicSeconds();
+    chunks = runStats.chunks;
+    arBundle->raw = raw;
+    if (GetOffsetAndSize(&arNodes[0], arBundle) == -1 ||
+        ProcessBundle(arNodes, node_cnt, arBundle, arBundleHeader, state, jobs) == -1) {
+      return -1;
+    }
+    secs = MonotonicSeconds() - start;
+    chunks = runStats.chunks - chunks;
+    mbps = arBundle->size / 1e6 / secs;
+    printf("run %d: %.1f MB, %" PRIu64 " chunks in %.3f s, %.1f MB/sec, %.1f chunks/sec\n",
+           run, arBundle->size / 1e6, chunks, secs, mbps, chunks / secs);
+    if (mbps > best) {
+      best = mbps;
+      bestChunks = chunks / secs;
+    }
+  }
 
+  getrusage(RUSAGE_SELF, &usage);
+  printf("bench: best of %d runs %.1f MB/sec, %.1f chunks/sec, peak RSS %.1f MB\n", spec->runs,
+         best, bestChunks, usage.ru_maxrss / 1024.0);
   return 0;
 }
 
@@ -628,11 +8462,50 @@ int main(int argc, char *argv[]) {
 
   int customPort = 0;
   char customPortStr[64];
+  int jobs = 1;
+  char *cacheDir = NULL;
+  char *batchFile = NULL;
+  FILE *batchIn;
+  struct Checkpoint checkpoint;
+  int status = EXIT_SUCCESS;
+  uint64_t cacheSizeMb = DEFAULT_CACHE_SIZE_MB;
+  struct ChunkCache cache;
   /* char tx[256]; */
-  struct ArweaveNode arNode;
+  struct ArweaveNode arNodes[MAX_NODES];
+  int node_cnt = 0;
+  char *portSep;
   struct ArweaveBundle arBundle;
   struct ArweaveBundleHeader arBundleHeader;
   struct StateMachine state;
+  struct sigaction sa;
+  double started;
+  char *benchSpec = NULL;
+  struct SynthSpec spec;
+  pid_t benchPid = 0;
+  char *itemsPath = NULL;
+  struct ItemJsonWriter itemWriter;
+  struct DataItemParser itemParser;
+  struct ChunkVerifier verifier;
+  struct BundleIndex bundleIndex;
+  struct LocalBundle local;
+  char *localPath = NULL;
+  int recursiveDepth = 0;
+  struct NestedPool nestedPool;
+  struct NestedScanner nestedScanner;
+  struct TagFilter filter;
+  uint64_t parsedBytes;
+  char *extractPath = NULL;
+  struct ExtractPlan plan;
+
+  runStats.started = MonotonicSeconds();
+  memset(arNodes, 0, sizeof(arNodes));
+  memset(&arBundle, 0, sizeof(arBundle));
+  memset(&state, 0, sizeof(state));
+  memset(&filter, 0, sizeof(filter));
+  BundleHeaderInit(&arBundleHeader);
+  base64urlSelectKernel();
+  JsonSelectKernel();
+  Sha256SelectKernel();
 
   while (optarg_end == 0) {
 
@@ -640,20 +8513,48 @@ int main(int argc, char *argv[]) {
 
     static struct option cli_options[] = {{"node", required_argument, 0, 'n'},
                                           {"tx", required_argument, 0, 't'},
-                                          {"port", optional_argument, 0, 'p'},
+                                          {"port", required_argument, 0, 'p'},
+                                          {"jobs", required_argument, 0, 'j'},
+                                          {"raw", no_argument, 0, 'r'},
+                                          {"item", required_argument, 0, 'i'},
+                                          {"unbundle", required_argument, 0, 'u'},
+                                          {"batch", required_argument, 0, 'b'},
+                                          {"cache", required_argument, 0, 'c'},
+                                          {"cache-size", required_argument, 0, 'C'},
+                                          {"resume", required_argument, 0, 'R'},
+                                          {"bench-base64", no_argument, 0, 'B'},
+                                          {"bench-json", no_argument, 0, 'J'},
+                                          {"stats", required_argument, 0, 'S'},
+                                          {"verbose", no_argument, 0, 'v'},
+                                          {"bench", required_argument, 0, 'X'},
+                                          {"serve", required_argument, 0, 'Z'},
+                                          {"hugepages", no_argument, 0, 'H'},
+                                          {"items", required_argument, 0, 'I'},
+                                          {"verify", no_argument, 0, 'V'},
+                                          {"index", required_argument, 0, 'x'},
+                                          {"file", required_argument, 0, 'f'},
+                                          {"stdin", no_argument, 0, 's'},
+                                          {"recursive", required_argument, 0, 'N'},
+                                          {"filter", required_argument, 0, 'F'},
+                                          {"extract", required_argument, 0, 'E'},
                                           {NULL, 0, 0, '\0'}};
 
-    optc = getopt_long(argc, argv, "n:t:p:", cli_options, &option_index);
+    optc = getopt_long(argc, argv, "n:t:p:j:i:u:b:v", cli_options, &option_index);
 
     if (optc == -1) {
       optarg_end = 1;
-      /* printf("bad argc %s\n\n", arNode.domain); */
       break;
     }
 
     switch (optc) {
     case 'n':
-      strcpy(arNode.domain, optarg);
+      // repeat --node to spread the chunk requests over several hosts
+      if (node_cnt == MAX_NODES) {
+        fprintf(stderr, "at most %d --node flags are supported\n", MAX_NODES);
+        return EXIT_FAILURE;
+      }
+      strncpy(arNodes[node_cnt].domain, optarg, sizeof(arNodes[node_cnt].domain) - 1);
+      node_cnt++;
       break;
 
     case 't':
@@ -664,44 +8565,427 @@ int main(int argc, char *argv[]) {
       customPort = 1;
       break;
 
+    case 'B':
+      return BenchBase64();
+
+    case 'J':
+      return BenchChunkJson();
+
+    case 'X':
+      benchSpec = optarg;
+      break;
+
+    case 'Z':
+      if (SynthSpecParse(&spec, optarg) == -1) {
+        return EXIT_FAILURE;
+      }
+      SynthRun(&spec, -1);
+      return EXIT_SUCCESS;
+
+    case 'r':
+      arBundle.raw = 1;
+      break;
+
+    case 'u':
+      arBundle.unbundle_dir = optarg;
+      break;
+
+    case 'b':
+      batchFile = optarg;
+      break;
+
+    case 'E':
+      extractPath = optarg;
+      break;
+
+    case 'c':
+      cacheDir = optarg;
+      break;
+
+    case 'C':
+      cacheSizeMb = strToLong(optarg);
+      break;
+
+    case 'S':
+      statsPath = optarg;
+      break;
+
+    case 'v':
+      verbose = 1;
+      break;
+
+    case 'H':
+      chunkPool.hugepages = 1;
+      break;
+
+    case 'I':
+      itemsPath = optarg;
+      break;
+
+    case 'V':
+      arBundle.verifier = &verifier;
+      break;
+
+    case 'x':
+      arBundle.index_dir = optarg;
+      break;
+
+    case 'f':
+      localPath = optarg;
+      break;
+
+    case 's':
+      localPath = "-";
+      break;
+
+    case 'F':
+      if (FilterAdd(&filter, optarg) == -1) {
+        fprintf(stderr, "--filter takes a tag name=value, %d of them at most\n", FILTER_MAX);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'N':
+      recursiveDepth = atoi(optarg);
+      if (recursiveDepth < 1) {
+        fprintf(stderr, "--recursive takes how many levels of nested bundles to go down\n");
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'R':
+      memset(&checkpoint, 0, sizeof(checkpoint));
+      strncpy(checkpoint.dir, optarg, sizeof(checkpoint.dir) - 1);
+      arBundle.checkpoint = &checkpoint;
+      break;
+
+    case 'i':
+      if (strlen(optarg) >= sizeof(arBundle.item_id)) {
+        fprintf(stderr, "--item takes a base64url data item id\n");
+        return EXIT_FAILURE;
+      }
+      strcpy(arBundle.item_id, optarg);
+      break;
+
+    case 'j':
+      jobs = atoi(optarg);
+      if (jobs < 1 || jobs > MAX_JOBS) {
+        fprintf(stderr, "--jobs has to be between 1 and %d\n", MAX_JOBS);
+        return EXIT_FAILURE;
+      }
+      break;
+
     case '?':
       break;
 
     default:
       fprintf(stderr,
-              "Usage: %s --node ARWEAVE_NODE_URL --port ARWEAVE_NODE_PORT --tx "
-              "ARWEAVE_BUNDLE_TX_ID\n",
-              argv[0]);
+              "Usage: %s --node ARWEAVE_NODE_URL[:PORT] [--node ...] --port ARWEAVE_NODE_PORT\n"
+              "       (--tx ARWEAVE_BUNDLE_TX_ID | --batch FILE|-) [--jobs N] [--raw] [--item DATA_ITEM_ID]\n"
+              "       [--unbundle DIR] [--cache DIR [--cache-size MB]] [--resume DIR]\n"
+              "       [--stats FILE|-] [--verbose] [--hugepages] [--items FILE|-] [--verify]\n"
+              "       [--index DIR] [--recursive DEPTH] [--filter NAME=VALUE ...] [--extract FILE|-]\n"
+              "   or: %s (--file PATH | --stdin) [--tx ID] [--item DATA_ITEM_ID] [--unbundle DIR]\n"
+              "       [--items FILE|-] [--index DIR] [--recursive DEPTH] [--filter NAME=VALUE ...]\n"
+              "       [--extract FILE|-] [--stats FILE|-] [--verbose]\n"
+              "   or: %s --bench SPEC [--jobs N] [--raw] [--unbundle DIR] ...\n"
+              "   or: %s --serve SPEC\n"
+              "SPEC is key=value,... of items, size=MIN-MAX, chunks, latency (ms[/ms...]),\n"
+              "bandwidth (MB/s), nodes, port, runs, seed, hangup, short and ranges\n",
+              argv[0], argv[0], argv[0], argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (benchSpec != NULL) {
+    if (node_cnt > 0 || strlen(arBundle.tx_id) > 0 || batchFile != NULL) {
+      fprintf(stderr, "--bench brings its own node and bundle\n");
+      return EXIT_FAILURE;
+    }
+    if (SynthSpecParse(&spec, benchSpec) == -1) {
+      return EXIT_FAILURE;
+    }
+    benchPid = BenchStart(&spec, arNodes, &node_cnt);
+    strcpy(arBundle.tx_id, "bench");
+  }
+
+  if (localPath != NULL) {
+    if (node_cnt > 0 || batchFile != NULL || benchSpec != NULL) {
+      fprintf(stderr, "--file and --stdin bring their own bundle\n");
+      return EXIT_FAILURE;
+    }
+    if (arBundle.raw || arBundle.verifier != NULL || cacheDir != NULL ||
+        arBundle.checkpoint != NULL) {
+      fprintf(stderr, "--raw, --verify, --cache and --resume need a --node\n");
       return EXIT_FAILURE;
     }
+    if (arBundle.tx_id[0] == 0) {
+      // the index and messages go by the file name then
+      strncpy(arBundle.tx_id, strcmp(localPath, "-") == 0 ? "stdin" : basename(localPath),
+              sizeof(arBundle.tx_id) - 1);
+    }
+    LocalOpen(&local, localPath, recursiveDepth > 0);
+    arBundle.local = &local;
   }
 
-  if (strlen(arNode.domain) == 0 || strlen(arBundle.tx_id) == 0) {
+  if ((node_cnt == 0 && localPath == NULL) ||
+      (strlen(arBundle.tx_id) == 0) == (batchFile == NULL)) {
     fprintf(stderr,
-            "Usage: %s --node ARWEAVE_NODE_URL --port ARWEAVE_NODE_PORT --tx "
-            "ARWEAVE_BUNDLE_TX_ID\n",
-            argv[0]);
+            "Usage: %s --node ARWEAVE_NODE_URL[:PORT] [--node ...] --port ARWEAVE_NODE_PORT\n"
+            "       (--tx ARWEAVE_BUNDLE_TX_ID | --batch FILE|-) [--jobs N] [--raw] [--item DATA_ITEM_ID]\n"
+            "       [--unbundle DIR] [--cache DIR [--cache-size MB]] [--resume DIR]\n"
+            "       [--stats FILE|-] [--verbose] [--hugepages] [--items FILE|-] [--verify]\n"
+            "       [--index DIR] [--recursive DEPTH] [--filter NAME=VALUE ...] [--extract FILE|-]\n"
+            "   or: %s (--file PATH | --stdin) [--tx ID] [--item DATA_ITEM_ID] [--unbundle DIR]\n"
+            "       [--items FILE|-] [--index DIR] [--recursive DEPTH] [--filter NAME=VALUE ...]\n"
+            "       [--extract FILE|-] [--stats FILE|-] [--verbose]\n"
+            "   or: %s --bench SPEC [--jobs N] [--raw] [--unbundle DIR] ...\n"
+            "   or: %s --serve SPEC\n"
+            "SPEC is key=value,... of items, size=MIN-MAX, chunks, latency (ms[/ms...]),\n"
+            "bandwidth (MB/s), nodes, port, runs, seed, hangup, short and ranges\n",
+            argv[0], argv[0], argv[0], argv[0]);
     return EXIT_FAILURE;
   }
 
-  if (customPort == 0) {
-    arNode.port = 1984;
+  // SIGUSR1 dumps the stats gathered so far
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = StatsSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+
+  if (verbose) {
+    printf("getting host by name \n");
   }
 
-  printf("getting host by name \n");
+  for (int i = 0; i < node_cnt; i++) {
+    struct ArweaveNode *arNode = &arNodes[i];
 
-  arNode.host = gethostbyname(arNode.domain);
+    // --node HOST:PORT overrides --port for that node
+    if ((portSep = strrchr(arNode->domain, ':')) != NULL) {
+      *portSep = 0;
+      arNode->port = atoi(portSep + 1);
+    } else if (customPort == 0) {
+      arNode->port = 1984;
+    } else {
+      arNode->port = atoi(customPortStr);
+    }
 
-  if (arNode.host == NULL) {
-    herror("gethostbyname");
+    started = MonotonicSeconds();
+    arNode->host = gethostbyname(arNode->domain);
+    StatsRecord(STAT_DNS, MonotonicSeconds() - started);
+
+    if (arNode->host == NULL) {
+      herror("gethostbyname");
+      exit(1);
+    }
+    arNode->addr = *((struct in_addr *)arNode->host->h_addr);
+    PoolInit(arNode);
+  }
+
+  if (batchFile != NULL && arBundle.item_id[0] != 0) {
+    fprintf(stderr, "--item takes a single --tx\n");
+    return EXIT_FAILURE;
+  }
+
+  if (arBundle.unbundle_dir != NULL) {
+    if (arBundle.item_id[0] != 0) {
+      fprintf(stderr, "--item and --unbundle don't go together\n");
+      return EXIT_FAILURE;
+    }
+    if (mkdir(arBundle.unbundle_dir, 0755) == -1 && errno != EEXIST) {
+      perror("mkdir");
+      exit(1);
+    }
+  }
+
+  if (cacheDir != NULL) {
+    CacheInit(&cache, cacheDir, cacheSizeMb * 1024 * 1024);
+    arBundle.cache = &cache;
+  }
+
+  if (arBundle.checkpoint != NULL && mkdir(checkpoint.dir, 0755) == -1 && errno != EEXIST) {
+    perror("mkdir");
     exit(1);
   }
 
-  printf("getting offset and size \n");
+  if (arBundle.index_dir != NULL && mkdir(arBundle.index_dir, 0755) == -1 && errno != EEXIST) {
+    perror("mkdir");
+    exit(1);
+  }
+
+  if (arBundle.verifier != NULL) {
+    if (arBundle.raw) {
+      fprintf(stderr, "--verify checks the proofs /chunk sends along, --raw ranges have none\n");
+      return EXIT_FAILURE;
+    }
+    VerifierInit(&verifier);
+  }
+
+  // the checkpoint keeps the chunks done, not what the item parser made of
+  // them, so a resumed run would start --items and --recursive half way in
+  if (arBundle.checkpoint != NULL && (itemsPath != NULL || recursiveDepth > 0)) {
+    fprintf(stderr, "--items and --recursive don't go with --resume\n");
+    return EXIT_FAILURE;
+  }
+
+  if (statsPath != NULL && strcmp(statsPath, "-") == 0) {
+    if (itemsPath != NULL && strcmp(itemsPath, "-") == 0) {
+      fprintf(stderr, "--stats and --items can't both go to stdout\n");
+      return EXIT_FAILURE;
+    }
+    statsOut = StdoutDetach();
+  }
+
+  if (itemsPath != NULL) {
+    memset(&itemWriter, 0, sizeof(itemWriter));
+    if (strcmp(itemsPath, "-") == 0) {
+      itemWriter.out = StdoutDetach();
+    } else if ((itemWriter.out = fopen(itemsPath, "w")) == NULL) {
+      perror("fopen");
+      exit(1);
+    }
+    DataItemParserInit(&itemParser, ItemJsonSpan, &itemWriter);
+    state.items = &itemParser;
+  }
+
+  if (recursiveDepth > 0) {
+    NestedPoolInit(&nestedPool, recursiveDepth, arBundle.unbundle_dir,
+                   itemsPath != NULL ? itemWriter.out : NULL);
+    NestedScannerInit(&nestedScanner, &nestedPool, 0, itemsPath != NULL ? ItemJsonSpan : NULL,
+                      &itemWriter);
+    DataItemParserInit(&itemParser, NestedSpan, &nestedScanner);
+    state.items = &itemParser;
+    state.nested = &nestedScanner;
+  }
+
+  if (filter.cnt > 0) {
+    if (arBundle.item_id[0] != 0 || arBundle.checkpoint != NULL) {
+      fprintf(stderr, "--filter doesn't go with --item or --resume\n");
+      return EXIT_FAILURE;
+    }
+    // it goes first, whatever else watches the items gets them all
+    if (state.items != NULL) {
+      filter.next = itemParser.span;
+      filter.next_ctx = itemParser.ctx;
+    }
+    DataItemParserInit(&itemParser, FilterSpan, &filter);
+    state.items = &itemParser;
+    arBundle.filter = &filter;
+  }
+
+  if (extractPath != NULL) {
+    if (arBundle.item_id[0] != 0 || arBundle.unbundle_dir != NULL || filter.cnt > 0 ||
+        arBundle.checkpoint != NULL || batchFile != NULL) {
+      fprintf(stderr,
+              "--extract doesn't go with --item, --unbundle, --filter, --resume or --batch\n");
+      return EXIT_FAILURE;
+    }
+    ExtractLoad(&plan, extractPath);
+    arBundle.plan = &plan;
+  }
+  // backoff jitter
+  srandom(getpid() ^ time(NULL));
+
+  if (benchPid > 0) {
+    if (RunBench(&spec, arNodes, node_cnt, &arBundle, &arBundleHeader, &state, jobs) == -1) {
+      status = EXIT_FAILURE;
+    }
+    kill(benchPid, SIGTERM);
+    waitpid(benchPid, NULL, 0);
+  } else if (batchFile != NULL) {
+    if (strcmp(batchFile, "-") == 0) {
+      batchIn = stdin;
+    } else if ((batchIn = fopen(batchFile, "r")) == NULL) {
+      perror("fopen");
+      exit(1);
+    }
+    if (RunBatch(arNodes, node_cnt, &arBundle, &arBundleHeader, &state, jobs, batchIn) > 0) {
+      status = EXIT_FAILURE;
+    }
+    if (batchIn != stdin) {
+      fclose(batchIn);
+    }
+  } else {
+    if (verbose) {
+      printf("getting offset and size \n");
+    }
+
+    started = MonotonicSeconds();
+    parsedBytes = runStats.chunk_bytes;
+    if (arBundle.local != NULL) {
+      LocalOffsets(&local, &arBundle);
+    }
+    // an indexed bundle needs no lookups to find the --item or --extract items
+    if (arBundle.index_dir != NULL && (arBundle.item_id[0] != 0 || arBundle.plan != NULL) &&
+        IndexOpen(&bundleIndex, arBundle.index_dir, arBundle.tx_id) == 0) {
+      arBundle.index = &bundleIndex;
+    }
+    if (arBundle.local == NULL &&
+        (arBundle.index == NULL || !IndexOffsets(&bundleIndex, &arBundle)) &&
+        GetOffsetAndSize(&arNodes[0], &arBundle) == -1) {
+      return EXIT_FAILURE;
+    }
+
+    if (ProcessBundle(arNodes, node_cnt, &arBundle, &arBundleHeader, &state, jobs) == -1) {
+      status = EXIT_FAILURE;
+    } else if (state.header_done != 1) {
+      fprintf(stderr, "bundle %s ended inside its header\n", arBundle.tx_id);
+      return EXIT_FAILURE;
+    } else if (arBundle.plan != NULL && plan.missing > 0) {
+      status = EXIT_FAILURE;
+    }
+    if (arBundle.local != NULL) {
+      started = MonotonicSeconds() - started;
+      parsedBytes = runStats.chunk_bytes - parsedBytes;
+      printf("parsed %.1f MB of %s in %.3f s, %.1f MB/sec\n", parsedBytes / 1e6,
+             arBundle.tx_id, started, parsedBytes / 1e6 / started);
+      LocalClose(&local);
+    }
+  }
+  BundleHeaderFree(&arBundleHeader);
+  if (arBundle.index != NULL) {
+    IndexClose(arBundle.index);
+  }
+
+  if (arBundle.verifier != NULL) {
+    VerifierDestroy(&verifier);
+    VerifierReport(&verifier);
+    if (verifier.failed > 0) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  if (state.nested != NULL) {
+    NestedPoolDestroy(&nestedPool);
+    NestedReport(&nestedPool);
+  }
+  if (arBundle.filter != NULL) {
+    FilterReport(&filter);
+    free(state.item_drop);
+  }
+  if (arBundle.plan != NULL) {
+    ExtractFree(&plan);
+  }
 
-  GetOffsetAndSize(&arNode, &arBundle);
+  if (state.items != NULL) {
+    printf("parsed %" PRIu64 " data item headers, %" PRIu64 " invalid\n", itemParser.items,
+           itemParser.invalid);
+    if (itemsPath != NULL) {
+      fclose(itemWriter.out);
+    }
+  }
 
-  ProcessBundle(&arNode, &arBundle, &arBundleHeader, &state);
+  for (int i = 0; i < node_cnt; i++) {
+    PoolDestroy(&arNodes[i]);
+  }
+  if (arBundle.cache != NULL) {
+    CacheReport(arBundle.cache);
+  }
+  if (statsPath != NULL) {
+    StatsDump();
+  }
+  ChunkPoolDestroy(&chunkPool);
 
   /*
   char domain[] = "sstatic.net";
@@ -782,5 +9066,5 @@ int main(int argc, char *argv[]) {
   printf("\n\nDone.\n\n");
   return 0;
   */
-  return 0;
+  return status;
 }
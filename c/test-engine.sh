@@ -0,0 +1,204 @@
+#!/bin/sh
+# Drive the --jobs engine against synthetic --serve nodes on loopback:
+# pipelined keep-alive connections, --raw byte ranges and their fallback to
+# /chunk, hedging across nodes of different latencies, nodes hanging up on
+# kept-alive connections, and a bundle with a short chunk in it.
+#
+# Then take a bundle of small items, whose headers straddle plenty of chunk
+# boundaries, off a node and check the data item parser, --filter, --index,
+# --extract and --resume against a plain --unbundle of it.
+#
+#   c/test-engine.sh [JOBS]
+set -eu
+
+cd "$(dirname "$0")"
+JOBS=${1:-8}
+WORK=$(mktemp -d)
+BIN=$WORK/bundle-dissector
+PIDS=
+
+cleanup() {
+  for pid in $PIDS; do
+    kill "$pid" 2>/dev/null || true
+  done
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+# serve NAME SPEC: start a node, NODES gets a --node per port it listens on
+serve() {
+  "$BIN" --serve "$2" > "$WORK/$1.serve" 2>&1 &
+  PIDS="$PIDS $!"
+  for _ in $(seq 100); do
+    grep -q '^serving' "$WORK/$1.serve" && break
+    sleep 0.1
+  done
+  NODES=$(grep '^serving' "$WORK/$1.serve" | grep -o '127\.0\.0\.1:[0-9]*' | sed 's/^/--node /')
+  [ -n "$NODES" ] || fail "node $1 didn't come up"
+}
+
+# unbundle NAME ARGS...: dissect the served bundle into $WORK/NAME
+unbundle() {
+  name=$1
+  shift
+  mkdir "$WORK/$name"
+  "$BIN" --tx synth --unbundle "$WORK/$name" "$@" > "$WORK/$name.log" 2>&1
+}
+
+# dissect NAME ARGS...: dissect the bundle on disk from within $WORK/NAME
+dissect() {
+  name=$1
+  shift
+  mkdir "$WORK/$name"
+  (cd "$WORK/$name" && "$BIN" --file "$BUNDLE" --tx small "$@") > "$WORK/$name.log" 2>&1
+}
+
+gcc -Wall -O2 main.c -o "$BIN" -lpthread
+
+SPEC=items=300,size=1k-1m,seed=7
+
+serve plain "$SPEC"
+unbundle j1 $NODES --jobs 1 || fail "--jobs 1"
+unbundle jn $NODES --jobs "$JOBS" || fail "--jobs $JOBS"
+diff -r "$WORK/j1" "$WORK/jn" > /dev/null || fail "--jobs $JOBS unbundled other bytes than --jobs 1"
+# every response came over a connection opened once and pipelined on
+served=$(sed -n 's/.*requests served: \([0-9]*\).*/\1/p' "$WORK/jn.log")
+opened=$(sed -n 's/.*connections opened: \([0-9]*\).*/\1/p' "$WORK/jn.log")
+[ "$opened" -le "$JOBS" ] && [ "$served" -gt "$opened" ] ||
+  fail "$served requests on $opened connections"
+echo "ok pipelined: $served requests on $opened connections"
+
+# --raw byte ranges against /chunk, sequential and through the engine
+for jobs in 1 "$JOBS"; do
+  unbundle raw$jobs $NODES --raw --jobs "$jobs" || fail "--raw --jobs $jobs"
+  diff -r "$WORK/j1" "$WORK/raw$jobs" > /dev/null ||
+    fail "--raw --jobs $jobs unbundled other bytes than /chunk"
+  grep -q 'falling back to /chunk' "$WORK/raw$jobs.log" && fail "--raw --jobs $jobs fell back"
+done
+echo "ok --raw unbundled the same bytes as /chunk"
+
+serve noranges "$SPEC,ranges=0"
+unbundle noranges $NODES --raw --jobs "$JOBS" || fail "--raw on a node without ranges"
+grep -q 'falling back to /chunk' "$WORK/noranges.log" || fail "--raw didn't fall back to /chunk"
+diff -r "$WORK/j1" "$WORK/noranges" > /dev/null || fail "the fallback unbundled other bytes"
+echo "ok --raw fell back to /chunk"
+
+# enough connections that the fast node has pipeline room for hedges,
+# whatever JOBS is
+serve nodes "$SPEC,nodes=3,latency=2/20/200"
+unbundle nodes $NODES --jobs 12 || fail "3 nodes"
+diff -r "$WORK/j1" "$WORK/nodes" > /dev/null || fail "3 nodes unbundled other bytes"
+# requests served, hedges sent and hedges won by each node that answered
+awk '/requests served:/ { served = $NF }
+     /^127\.0\.0\.1:[0-9]* latency/ { print $1, served, $(NF - 2), $NF }' \
+  "$WORK/nodes.log" > "$WORK/nodes.stats"
+set -- $(awk '{ sent += $3; won += $4 } END { print sent + 0, won + 0 }' "$WORK/nodes.stats")
+[ "$1" -gt 0 ] && [ "$2" -gt 0 ] || fail "$1 hedges sent, $2 won"
+# the first node is the 2 ms one
+fastest=$(echo $NODES | cut -d ' ' -f 2)
+fast=$(awk -v node="$fastest" '$1 == node { print $2 }' "$WORK/nodes.stats")
+slow=$(awk -v node="$fastest" '$1 != node { sum += $2 } END { print sum + 0 }' "$WORK/nodes.stats")
+[ "${fast:-0}" -gt "$slow" ] || fail "the fastest node served ${fast:-0} requests, the others $slow"
+echo "ok 3 nodes: the fastest served $fast requests to $slow, $2 of $1 hedges won"
+
+serve hangup "$SPEC,hangup=3"
+for jobs in 1 "$JOBS"; do
+  unbundle hangup$jobs $NODES --jobs "$jobs" || fail "--jobs $jobs with nodes hanging up"
+  diff -r "$WORK/j1" "$WORK/hangup$jobs" > /dev/null ||
+    fail "requests replayed by --jobs $jobs unbundled other bytes"
+  echo "ok --jobs $jobs replayed hangups over" \
+    "$(sed -n 's/.*connections opened: \([0-9]*\).*/\1/p' "$WORK/hangup$jobs.log") connections"
+done
+
+serve short "$SPEC,short=5"
+if unbundle short $NODES --jobs "$JOBS"; then
+  fail "a short chunk went by unnoticed"
+fi
+grep -q "aren't 262144 bytes aligned" "$WORK/short.log" || fail "no alignment error"
+echo "ok short chunk refused"
+
+serve small items=3000,size=1k-3k,seed=7
+BUNDLE=$WORK/small.bundle
+curl -sf -o "$BUNDLE" "http://$(echo $NODES | cut -d ' ' -f 2)/raw/small" ||
+  fail "couldn't get the bundle off the node"
+
+# one line per item, each with the Synth-Shard tag of its index and the
+# same header size, the rest of the item being its data
+dissect items --unbundle . --items ../items.jsonl || fail "--file --items"
+[ "$(wc -l < "$WORK/items.jsonl")" -eq 3000 ] || fail "--items didn't write 3000 lines"
+grep -q '"error"' "$WORK/items.jsonl" && fail "--items found invalid items"
+sed 's/^{"item":\([0-9]*\),"id":"\([^"]*\)".*"name":"Synth-Shard","value":"\([0-9]*\)".*"data_size":\([0-9]*\)}$/\1 \2 \3 \4/' \
+  "$WORK/items.jsonl" > "$WORK/items.fields"
+(cd "$WORK/items" && find . -type f -exec wc -c {} +) | sed -n 's|^ *\([0-9]*\) \./|\1 |p' \
+  > "$WORK/items.sizes"
+awk 'NR == FNR { size[$2] = $1; next }
+     NF != 4 || $1 % 100 != $3 + 0 { print "tag of item", $1; exit 1 }
+     !header { header = size[$2] - $4 }
+     size[$2] - $4 != header { print "data size of item", $1; exit 1 }' \
+  "$WORK/items.sizes" "$WORK/items.fields" || fail "--items and --unbundle don't agree"
+cat "$BUNDLE" | "$BIN" --stdin --items "$WORK/piped.jsonl" > "$WORK/piped.log" 2>&1 ||
+  fail "--stdin --items"
+cmp -s "$WORK/items.jsonl" "$WORK/piped.jsonl" || fail "piped --items differ from --file ones"
+echo "ok --items parsed 3000 headers across $(($(wc -c < "$BUNDLE") / 262144)) chunk boundaries"
+
+# a pipe cut inside a header leaves that item's line closed with an error
+cut=$(sed -n 's/^{"item":1500,.*"data_start":\([0-9]*\),.*/\1/p' "$WORK/items.jsonl")
+if head -c $((cut - 100)) "$BUNDLE" | "$BIN" --stdin --items "$WORK/cut.jsonl" \
+    > "$WORK/cut.log" 2>&1; then
+  fail "a bundle cut short went by unnoticed"
+fi
+tail -n 1 "$WORK/cut.jsonl" | grep -q '^{"item":1500,.*"error":"[^"]*"}$' ||
+  fail "the item the input stopped in isn't closed with an error"
+grep -vq '}$' "$WORK/cut.jsonl" && fail "--items left a line open"
+echo "ok a header cut short gets an error line"
+
+dissect filter --filter Synth-Shard=07 --unbundle . || fail "--filter"
+awk '$3 == 7 { print $2 }' "$WORK/items.fields" | sort > "$WORK/filter.want"
+ls "$WORK/filter" | sort | cmp -s - "$WORK/filter.want" || fail "--filter kept other items"
+for id in $(cat "$WORK/filter.want"); do
+  cmp -s "$WORK/items/$id" "$WORK/filter/$id" || fail "--filter wrote other bytes for $id"
+done
+echo "ok --filter kept $(wc -l < "$WORK/filter.want") items"
+
+awk 'NR == 1 || NR == 1501 || NR == 3000 { print $2 }' "$WORK/items.fields" > "$WORK/want"
+dissect extract --extract ../want || fail "--extract"
+for id in $(cat "$WORK/want"); do
+  cmp -s "$WORK/items/$id" "$WORK/extract/$id" || fail "--extract wrote other bytes for $id"
+done
+echo "ok --extract pulled out $(wc -l < "$WORK/want") items"
+
+dissect index --index ../index || fail "--index"
+dissect indexed --index ../index --extract ../want || fail "--extract by the index"
+grep -q '^index: 3 of 3 items' "$WORK/indexed.log" || fail "--extract didn't go by the index"
+for id in $(cat "$WORK/want"); do
+  cmp -s "$WORK/items/$id" "$WORK/indexed/$id" || fail "the index led to other bytes for $id"
+done
+echo "ok --index round trip"
+
+# killed once a checkpoint is down, then picked up where it stopped
+serve slow items=3000,size=1k-3k,seed=7,latency=100
+mkdir "$WORK/resume" "$WORK/checkpoints"
+"$BIN" --tx small $NODES --resume "$WORK/checkpoints" --unbundle "$WORK/resume" \
+  > "$WORK/killed.log" 2>&1 &
+pid=$!
+sleep 1.5
+kill "$pid"
+wait "$pid" 2>/dev/null && fail "--resume run finished before it was killed"
+"$BIN" --tx small $NODES --resume "$WORK/checkpoints" --unbundle "$WORK/resume" \
+  > "$WORK/resumed.log" 2>&1 || fail "--resume"
+grep -q '^resuming small' "$WORK/resumed.log" || fail "--resume started over"
+diff -r "$WORK/items" "$WORK/resume" > /dev/null || fail "--resume unbundled other bytes"
+echo keep > "$WORK/keep.jsonl"
+if "$BIN" --tx small $NODES --resume "$WORK/checkpoints" --items "$WORK/keep.jsonl" \
+    > "$WORK/refused.log" 2>&1; then
+  fail "--items went with --resume"
+fi
+[ "$(cat "$WORK/keep.jsonl")" = keep ] || fail "a refused --resume run wrote --items"
+echo "ok --resume $(sed -n 's/^resuming small at offset [0-9]*, \(.*\) done/\1/p' "$WORK/resumed.log") done before"
+
+echo "all checks passed"